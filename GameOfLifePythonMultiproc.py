@@ -29,13 +29,13 @@ VEGIES_INDEX = 1
 #                   simulate.
 #     prob: The probability of vegetation being placed in any given grid space.
 #     seed0: The original seed given in the input.
+#     firstSim: The number of this process's first simulation, starting at 1.
 #     mySims: The number of simulations this process will run.
-#     myProcess: Which process number this is, starting at 1.
 #     queue: The queue used to hold the results of all simulations run by this
 #            process, where each is a pair of integers stored in a tuple.
 # OUTPUTS: None.
 ###########################
-def worker(nx, ny, maxSteps, maxUnchanged, prob, seed0, mySims, myProcess, 
+def worker(nx, ny, maxSteps, maxUnchanged, prob, seed0, firstSim, mySims,
            queue):
     steps = 0
     vegies = 0
@@ -43,13 +43,44 @@ def worker(nx, ny, maxSteps, maxUnchanged, prob, seed0, mySims, myProcess,
     grid = [[0 for i in xrange(MAX_X + 2)] for j in xrange(MAX_Y + 2)]
     
     for i in xrange(mySims):
-        seed = seed0 * ((myProcess * mySims) - i)
+        seed = simulationSeed(seed0, firstSim + i)
         initializeGrid(grid, nx, ny, seed, prob)
         steps, vegies = gameOfLife(grid, nx, ny, maxSteps, maxUnchanged)
         queue.put((steps, vegies)) 
     return
 
 
+###########################
+# Wraps an integer around to a signed 32-bit value, as C int arithmetic does.
+#
+# INPUTS:
+#     value: The integer to wrap.
+# OUTPUTS:
+#     The value as a signed 32-bit integer.
+###########################
+def toInt32(value):
+    value = value & 0xFFFFFFFF
+    if (value >= 0x80000000):
+        value -= 0x100000000
+    return value
+
+
+###########################
+# Computes the seed of a simulation the same way as JJonesLifeThreaded.cpp.
+# It depends only on the simulation's number, never on the process that runs
+# it, so simulation k gets the same grid however many processes share the
+# work, in either version.
+#
+# INPUTS:
+#     seed0: The original seed given in the input.
+#     number: The number of the simulation, starting at 1.
+# OUTPUTS:
+#     The seed of the simulation.
+###########################
+def simulationSeed(seed0, number):
+    return toInt32(seed0 * number)
+
+
 ###########################
 # Initializes an empty grid given grid dimensions, a seed, and vegetation 
 # probability.
@@ -69,7 +100,7 @@ def initializeGrid(grid, nx, ny, seed, prob):
     for i in xrange(1, nx + 1):
         for j in xrange(1, ny + 1):
             index = ny * i + j
-            newSeed = seed + index
+            newSeed = toInt32(seed + index)
             
             if (rand1(newSeed) > prob):
                 grid[i][j] = 0
@@ -236,6 +267,9 @@ def main():
     seed0 = 0 # random number seed given by input
     numProcesses = 0 # total number of processes to use
     simsPerProcess = 0 # number of simulations each process will run
+    leftOverSims = 0 # number of processes that run one simulation more
+    firstSim = 1 # number of the next process's first simulation
+    mySims = 0 # number of simulations the next process will run
     queueList = [] # a list of queues
     processList = [] # a list of processes
     queueResults = () # a tuple which will hold the results of a process
@@ -263,19 +297,24 @@ def main():
     seed0 = int(input())
     
     simsPerProcess = nsims // numProcesses
+    leftOverSims = nsims % numProcesses
     
     # Create processes and run each one's simulations. Each one will have a 
     # corresponding queue, which will be used to retrieve the results of the 
-    # processors simulations.
+    # processors simulations. The processes run simulations 1 to nsims in
+    # consecutive blocks, the first ones one simulation more when nsims does
+    # not divide evenly.
     
     for i in xrange(numProcesses):
+        mySims = simsPerProcess + (1 if i < leftOverSims else 0)
         queue = multiprocessing.Queue()
         process = multiprocessing.Process(target=worker, args=(nx, ny, maxSteps,
                                           maxUnchanged, probability, seed0, 
-                                          simsPerProcess, i + 1, queue,))
+                                          firstSim, mySims, queue,))
         queueList.append(queue)
         processList.append(process)
         process.start()
+        firstSim += mySims
         
     # Get and record the results of each process's simulations.
     
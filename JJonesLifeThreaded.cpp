@@ -3,19 +3,46 @@
  *
  *  Created on: Feb 19, 2016
  *      Author: Jordan Jones
+ *
+ *  Build with mpicxx. Add -DUSE_NUMA -lnuma to bind grid memory to the
+ *  local NUMA node explicitly rather than relying on first touch, and
+ *  -DUSE_ZSTD -lzstd to offer zstd compressed snapshots.
  */
 
+# include <atomic>
+# include <condition_variable>
 # include <cstdlib>
 # include <iostream>
 # include <iomanip>
+# include <mutex>
+# include <thread>
 # include "mpi.h"
 # include "math.h"
 # include <stdio.h>
+# include <stdarg.h>
+# include <stdint.h>
+# include <limits.h>
+# include <string.h>
+# include <sched.h>
+# include <unistd.h>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
 
-using namespace std;
+# ifdef USE_NUMA
+# include <numa.h>
+# endif
+
+# ifdef USE_ZSTD
+# include <zstd.h>
+# endif
+
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define HAVE_X86_SIMD
+# include <immintrin.h>
+# endif
 
-# define MAX_X 500
-# define MAX_Y 500
+using namespace std;
 
 # define STEPS_MAX 200
 # define UNCHANGED_MAX 10
@@ -23,260 +50,5645 @@ using namespace std;
 # define NVEGIES_INDEX 0
 # define NSTEPS_INDEX 1
 
+# define OUTCOME_DIED 0
+# define OUTCOME_UNSETTLED 1
+# define OUTCOME_STABLE 2
+
+# define VERBOSE_NONE 0
+# define VERBOSE_SUMMARY 1
+# define VERBOSE_SIM 2
+
+# define LOG_BUFFER_SIZE 1024
+
+# define SERIES_CAPACITY (1 << 20)
+# define SERIES_BATCH (1 << 16)
+
+# define SNAPSHOT_RAW 0
+# define SNAPSHOT_RLE 1
+# define SNAPSHOT_ZSTD 2
+# define SNAPSHOT_CHUNK_ROWS 256
+
+# define RASTER_CHUNK_BYTES (1 << 20)
+
+# define PROB_CONSTANT 0
+# define PROB_GRADIENT 1
+# define PROB_FILE 2
+
+# define CHECK_EVERY 8
+
+# define NODE_SHARE_ALIGN 64
+
+# define WORK_CHUNKS_PER_RANK 16
+# define WORK_CHUNK_MAX 64
+
+# define NODE_BATCH_READY 0
+# define NODE_BATCH_REFILLING 1
+# define NODE_BATCH_DONE 2
+
+# define RESULTS_TAG 1
+# define PROGRESS_TAG 6
+# define STOP_TAG 7
+# define CHUNK_TAG 8
+
+# define COORDINATOR_POLL_US 200
+
+# define SWEEP_CHUNK_MAX 256
+# define SWEEP_CHUNKS_PER_WORKER 4
+
+# define VERIFY_SIZE_MAX 96
+
+# define TUNE_STEPS 20
+# define TUNE_RUNS 3
+# define TUNE_SEED 1
+
+# define SKETCH_GAMMA 1.02
+# define SKETCH_BUCKETS 1088
+
+/*
+ * Most cells a grid may have. Vegetation totals and cell indices are ints,
+ * and with cells below 16 this keeps every total of a grid within one.
+ */
+# define CELLS_MAX (INT_MAX / 16)
+
+/* Row i of a grid with ny columns plus a one cell halo on every side. */
+# define ROW(grid, ny, i) ((grid) + (size_t) (i) * ((ny) + 2))
+
+/* Bit-planes per cell, and bits of a neighbour sum, in a bitsliced grid. */
+# define SLICE_PLANES 4
+# define SLICE_SUM_BITS 7
+
+/* Row i of a bitsliced grid: SLICE_PLANES planes of words 64-bit words. */
+# define SLICE_ROW(cells, words, i) \
+      ((cells) + (size_t) (i) * SLICE_PLANES * (words))
+
+# define HUGE_PAGE_SIZE (2UL << 20)
+# define POOL_SLOTS_MAX 3
+
 
 /**
- * Main method to run the game of life, using the MPI.
+ * Growth rule for the vegetation model, with every threshold fixed at compile
+ * time. A cell loses one unit of vegetation when the sum of its eight
+ * neighbours is at most DECAY_LOW or at least DECAY_HIGH, gains one unit when
+ * the sum is at most GROW_MAX, and is otherwise unchanged. Cell values are
+ * clamped to [VEG_MIN, VEG_MAX].
+ *
+ * Because the thresholds are template arguments, each rule variant gets its
+ * own copy of the kernel in which every comparison is against a constant,
+ * and the update below compiles to compares and conditional moves that the
+ * compiler is free to unroll and vectorize.
  */
-int main(int argc, char *argv[])
+template <int DECAY_LOW, int GROW_MAX, int DECAY_HIGH, int VEG_MIN, int VEG_MAX>
+struct GrowthRule
 {
-   // Variables
+   static const int decayLow = DECAY_LOW;
+   static const int growMax = GROW_MAX;
+   static const int decayHigh = DECAY_HIGH;
+   static const int vegMin = VEG_MIN;
+   static const int vegMax = VEG_MAX;
+   static const int neighborMax = 8 * VEG_MAX; /* largest neighbour sum */
 
-   int mySimsToRun;
-   int leftOverSims;
-   int simulationNumber;
-   const int MASTER = 0;
-   const int NX_TAG = 1;
-   const int NY_TAG = 2;
-   const int PROB_TAG = 3;
-   const int NSIMS_TAG = 4;
-   const int SEED0_TAG = 5;
+   /**
+    * Computes the next value of a cell without branching.
+    *
+    * @param cell
+    *           is the current vegetation value of the cell
+    * @param neighbors
+    *           is the sum of the eight neighbouring vegetation values
+    * @return the vegetation value of the cell after one time step
+    */
+   static constexpr int update(int cell, int neighbors)
+   {
+      int decay = (neighbors <= DECAY_LOW) | (neighbors >= DECAY_HIGH);
+      int grow = (neighbors <= GROW_MAX) & (decay ^ 1);
+      int next = cell + grow - decay;
 
-   int grid[MAX_X + 2][MAX_Y + 2]; /* grid of vegetation values */
-   int nx; /* x dimension of grid */
-   int ny; /* y dimension of grid */
-   int maxSteps; /* max # timesteps to simulate */
-   int maxUnchanged; /* max # timesteps with no vegetation change */
-   int vegies; /* amount of stable vegetation */
-   int nsteps; /* number of steps actually run */
-   int nsims; /* number of simulations to perform */
+      next = next < VEG_MIN ? VEG_MIN : next;
+      next = next > VEG_MAX ? VEG_MAX : next;
+      return next;
+   }
+
+   /**
+    * Computes the same value as update, branching on the rule's tests. On
+    * real grids neighbouring cells mostly take the same branch, so a loop
+    * that handles one cell at a time runs faster this way.
+    *
+    * @param cell
+    *           is the current vegetation value of the cell
+    * @param neighbors
+    *           is the sum of the eight neighbouring vegetation values
+    * @return the vegetation value of the cell after one time step
+    */
+   static int updateBranching(int cell, int neighbors)
+   {
+      if (neighbors <= DECAY_LOW || neighbors >= DECAY_HIGH)
+         cell = cell - 1;
+      else if (neighbors <= GROW_MAX)
+         cell = cell + 1;
+
+      cell = cell < VEG_MIN ? VEG_MIN : cell;
+      cell = cell > VEG_MAX ? VEG_MAX : cell;
+      return cell;
+   }
+};
+
+/* Neighbours <= 3 or >= 25 decay, <= 15 grow, values clamped to [0, 10]. */
+typedef GrowthRule<3, 15, 25, 0, 10> StandardRule;
+
+
+/**
+ * The whole transition of a rule, precomputed for every (neighbour sum, cell)
+ * pair. For the standard rule this is 81 x 11 entries. The table is built at
+ * compile time, so each rule variant gets its own constant table.
+ */
+template <class Rule>
+struct TransitionTable
+{
+   static const int numCells = Rule::vegMax + 1; /* row length of the table */
+   static const int size = (Rule::neighborMax + 1) * numCells;
+
+   int next[size]; /* next[neighbors * numCells + cell] */
+
+   constexpr TransitionTable() : next()
+   {
+      for (int neighbors = 0; neighbors <= Rule::neighborMax; neighbors++)
+      {
+         for (int cell = 0; cell < numCells; cell++)
+            next[neighbors * numCells + cell] = Rule::update(cell, neighbors);
+      }
+   }
+};
+
+
+/**
+ * Ways of applying a rule to one row of cells, given the neighbour sum of
+ * every cell in the row. Each one provides
+ *
+ *    static void row(const int *cells, const int *neighbors, int *next, int n)
+ *
+ * and is plugged into gameOfLife as a template argument.
+ */
+
+/*
+ * Evaluates the rule's compares and clamps for every cell. It also works a
+ * cell at a time, for FusedSum.
+ */
+template <class Rule>
+struct ComputeUpdate
+{
+   static int cell(int cell, int neighbors)
+   {
+      return Rule::updateBranching(cell, neighbors);
+   }
+
+   static void row(const int *cells, const int *neighbors, int *next, int n)
+   {
+      for (int j = 0; j < n; j++)
+         next[j] = Rule::update(cells[j], neighbors[j]);
+   }
+};
+
+/* Looks every cell up in the rule's transition table. */
+template <class Rule>
+struct TableUpdate
+{
+   static_assert(Rule::vegMin >= 0, "table rules need non-negative cells");
+
+   static constexpr TransitionTable<Rule> table = TransitionTable<Rule>();
+
+   static void row(const int *cells, const int *neighbors, int *next, int n)
+   {
+      for (int j = 0; j < n; j++)
+         next[j] = table.next[neighbors[j] * table.numCells + cells[j]];
+   }
+};
+
+template <class Rule>
+constexpr TransitionTable<Rule> TableUpdate<Rule>::table;
+
+# ifdef HAVE_X86_SIMD
+/*
+ * Looks cells up in the transition table eight at a time with AVX2 gathers.
+ * Compiled for AVX2 regardless of the build flags; only pick it when the
+ * CPU supports AVX2.
+ */
+template <class Rule>
+struct GatherUpdate
+{
+   __attribute__((target("avx2")))
+   static void row(const int *cells, const int *neighbors, int *next, int n)
+   {
+      const int *table = TableUpdate<Rule>::table.next;
+      const __m256i numCells =
+            _mm256_set1_epi32(TransitionTable<Rule>::numCells);
+      int j = 0;
+
+      for (; j + 8 <= n; j += 8)
+      {
+         __m256i c = _mm256_loadu_si256((const __m256i*) (cells + j));
+         __m256i s = _mm256_loadu_si256((const __m256i*) (neighbors + j));
+         __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(s, numCells), c);
+         _mm256_storeu_si256((__m256i*) (next + j),
+               _mm256_i32gather_epi32(table, index, 4));
+      }
+      for (; j < n; j++)
+         next[j] = table[neighbors[j] * TransitionTable<Rule>::numCells
+               + cells[j]];
+   }
+};
+# endif
+
+
+/**
+ * Ways of computing the neighbour sums for one time step. Each one provides
+ *
+ *    template <class Update>
+ *    static void step(const int *grid, int *next, int nx, int ny,
+ *          int *scratch)
+ *
+ * which fills rows 1..nx of next from grid (whose halo is already filled in),
+ * handing each row of sums to the Update policy. scratch has room for
+ * 2 * (ny + 2) ints.
+ */
+
+/* Adds up the eight neighbours of every cell: 8 loads and 7 adds per cell. */
+struct DirectSum
+{
+   template <class Update>
+   static void step(const int *grid, int *next, int nx, int ny, int *scratch)
+   {
+      int *neighbors = scratch; /* quantity of neighboring vegetation */
+
+      for (int i = 1; i <= nx; i++)
+      {
+         const int *up = ROW(grid, ny, i - 1);
+         const int *mid = ROW(grid, ny, i);
+         const int *down = ROW(grid, ny, i + 1);
+
+         for (int j = 1; j <= ny; j++)
+         {
+            neighbors[j] = up[j - 1] + up[j] + up[j + 1] + mid[j - 1]
+                  + mid[j + 1] + down[j - 1] + down[j] + down[j + 1];
+         }
+         Update::row(mid + 1, neighbors + 1, ROW(next, ny, i) + 1, ny);
+      }
+   }
+};
+
+/*
+ * Adds up the eight neighbours of a cell and applies the rule to it in the
+ * same pass, as the original kernel did, so no row of sums goes through
+ * memory. It needs an Update policy that works a cell at a time, and is the
+ * fastest way to run the plain compute update.
+ */
+struct FusedSum
+{
+   template <class Update>
+   static void step(const int *grid, int *next, int nx, int ny,
+         int * /*scratch*/)
+   {
+      for (int i = 1; i <= nx; i++)
+      {
+         const int *up = ROW(grid, ny, i - 1);
+         const int *mid = ROW(grid, ny, i);
+         const int *down = ROW(grid, ny, i + 1);
+         int *out = ROW(next, ny, i);
+
+         for (int j = 1; j <= ny; j++)
+         {
+            out[j] = Update::cell(mid[j], up[j - 1] + up[j] + up[j + 1]
+                  + mid[j - 1] + mid[j + 1] + down[j - 1] + down[j]
+                  + down[j + 1]);
+         }
+      }
+   }
+};
+
+/*
+ * Keeps the vertical sum of three cells for every column in a rolling buffer.
+ * Moving down a row updates each column sum with one add and one subtract,
+ * and a cell's neighbourhood is then three column sums minus the cell
+ * itself. Both loops are plain array arithmetic that the compiler vectorizes,
+ * and the sums feed any Update policy, including the SIMD ones.
+ */
+struct ColumnSum
+{
+   template <class Update>
+   static void step(const int *grid, int *next, int nx, int ny, int *scratch)
+   {
+      int *columns = scratch; /* sums of rows i - 1, i and i + 1 */
+      int *neighbors = scratch + ny + 2; /* neighbouring vegetation */
+      int i, j; /* loop counters */
+
+      for (j = 0; j <= ny + 1; j++)
+      {
+         columns[j] = ROW(grid, ny, 0)[j] + ROW(grid, ny, 1)[j]
+               + ROW(grid, ny, 2)[j];
+      }
+
+      for (i = 1; i <= nx; i++)
+      {
+         const int *mid = ROW(grid, ny, i);
+
+         if (i > 1)
+         {
+            const int *leaving = ROW(grid, ny, i - 2);
+            const int *entering = ROW(grid, ny, i + 1);
+
+            for (j = 0; j <= ny + 1; j++)
+               columns[j] = columns[j] + entering[j] - leaving[j];
+         }
+         for (j = 1; j <= ny; j++)
+            neighbors[j] = columns[j - 1] + columns[j] + columns[j + 1]
+                  - mid[j];
+         Update::row(mid + 1, neighbors + 1, ROW(next, ny, i) + 1, ny);
+      }
+   }
+};
+
+
+/**
+ * Recorder for the vegetation of every time step of every simulation a rank
+ * runs. Kernels push values into a preallocated ring buffer, and a writer
+ * thread drains it to the rank's file in batches of SERIES_BATCH values, so
+ * the kernel never waits on the file system unless the ring fills up.
+ *
+ * The file is a 16-byte header ("LIFESER1", the rank and a reserved 0)
+ * followed by int32 values. Each simulation is its per-step vegetation
+ * values followed by its simulation number, negated to mark the end.
+ */
+struct SeriesRecorder
+{
+   int32_t *ring; /* SERIES_CAPACITY values */
+   std::atomic<size_t> head; /* total values pushed */
+   std::atomic<size_t> tail; /* total values written */
+   std::atomic<bool> done; /* no more values will be pushed */
+   std::mutex lock; /* guards sleeping on wake */
+   std::condition_variable wake; /* signals the writer or a waiting pusher */
+   FILE *file; /* the rank's series file */
+   std::thread writer; /* thread that drains the ring */
+};
+
+/**
+ * Header of a grid snapshot file. The cells follow as nx * ny uint8 values,
+ * row by row without the halo. For SNAPSHOT_RAW they follow the header
+ * directly, so a reader can map the file and use the cells in place. The
+ * compressed encodings cut the cells into chunks of SNAPSHOT_CHUNK_ROWS
+ * rows. numChunks int64 chunk sizes come right after the header, then the
+ * compressed chunks. SNAPSHOT_RLE chunks are (count, value) byte pairs.
+ */
+struct SnapshotHeader
+{
+   char magic[8]; /* "LIFESNP1" */
+   int32_t nx; /* x dimension of the grid */
+   int32_t ny; /* y dimension of the grid */
+   int32_t simulation; /* simulation number, 0 if not from a simulation */
+   int32_t step; /* time step the grid was taken at */
+   int32_t encoding; /* SNAPSHOT_RAW, SNAPSHOT_RLE or SNAPSHOT_ZSTD */
+   int32_t numChunks; /* number of compressed chunks, 0 for raw */
+   int64_t payloadBytes; /* bytes after the header */
+   int64_t reserved[3]; /* always 0, pads the header to 64 bytes */
+};
+
+/**
+ * Settings for writing grid snapshots, named
+ * "<prefix>.<simulation>.<step>.snp".
+ */
+struct SnapshotWriter
+{
+   const char *prefix; /* start of every snapshot file name */
+   int every; /* write a snapshot every this many steps, 0 for never */
+   bool final; /* write the final grid of every simulation */
+   int encoding; /* SNAPSHOT_RAW, SNAPSHOT_RLE or SNAPSHOT_ZSTD */
+   int simulation; /* number of the simulation being run */
+};
+
+/**
+ * Digests of the grid at every time step of one simulation, for comparing
+ * the steps of two kernels without keeping whole grids.
+ */
+struct GridTrace
+{
+   uint64_t digests[STEPS_MAX]; /* FNV-1a hash of the cells at each step */
+   int count; /* number of steps traced */
+};
+
+/**
+ * Observers a kernel calls every time step. Any member may be NULL.
+ */
+struct StepHooks
+{
+   SeriesRecorder *series; /* receives the vegetation of every step */
+   SnapshotWriter *snapshots; /* writes the grid every few steps */
+   GridTrace *trace; /* receives a digest of the grid every step */
+};
+
+/**
+ * Tracks the total vegetation of a simulation from step to step, to tell when
+ * it has settled: when the total has matched one of the last three totals for
+ * maxUnchanged steps in a row. Every kernel uses it, so they all stop at the
+ * same step.
+ */
+struct ConvergenceTracker
+{
+   int oldVegies[3]; /* totals of the last three steps, newest first */
+   int numUnchanged; /* # timesteps with no vegetation change */
+};
+
+typedef int (*LifeKernel)(int*, int, int, int, int, int*, StepHooks*);
+
+template <class Sum, class Update>
+int gameOfLife(int*, int, int, int, int, int*, StepHooks*);
+
+template <class Rule>
+int sliceLife(int*, int, int, int, int, int*, StepHooks*);
+
+# ifdef HAVE_X86_SIMD
+template <class Rule>
+int byteLife(int*, int, int, int, int, int*, StepHooks*);
+# endif
+
+
+/**
+ * Bump allocator for grid buffers, backed by one mapping that is made with
+ * huge pages where the system allows it. Each rank sets up one arena for the
+ * job and reuses it for every simulation, so large grids pay for their page
+ * faults and TLB entries once.
+ */
+struct GridArena
+{
+   char *base; /* start of the mapping */
+   size_t size; /* size of the mapping in bytes */
+   size_t used; /* bytes handed out so far */
+   const char *pages; /* "hugetlb", "transparent" or "normal" */
+};
+
+GridArena gridArena; /* this rank's arena */
+
+
+/**
+ * Fixed-size grid buffers carved out of the arena once, with a free list so
+ * that taking and returning a buffer costs a push or a pop. Every slot is
+ * big enough for the largest grid in the job plus the row buffers a kernel
+ * needs, so simulations of any size in the job run without allocating. The
+ * pool has only as many slots as the job holds at once, from poolSlots. The
+ * pool belongs to one rank and is not shared between threads.
+ */
+struct GridPool
+{
+   size_t slotBytes; /* size of each slot */
+   int numSlots; /* number of slots in the pool */
+   int numFree; /* number of slots on the free list */
+   void *free[POOL_SLOTS_MAX]; /* stack of free slots */
+};
+
+GridPool gridPool; /* this rank's pool */
+
+/**
+ * An engine that can be chosen at launch with "-engine <name>", and the CPU
+ * feature it needs, as named in CPU_FEATURES. findKernel only hands out the
+ * engines the CPU running it supports, so one build runs on every CPU
+ * generation in a cluster.
+ */
+struct EngineEntry
+{
+   const char *name; /* name given to -engine */
+   const char *feature; /* CPU feature the engine needs, or NULL */
+};
+
+/**
+ * The engines. "compute" uses FusedSum, and "table" and "gather" DirectSum.
+ * The "colsum" engines use ColumnSum instead. The "gather" engines need
+ * AVX2. "byte-avx512" keeps cells in bytes and needs AVX-512BW. "bitslice"
+ * keeps each bit of the cells in its own plane of 64-bit words. "-engine
+ * auto" times the engines this CPU supports and picks the fastest.
+ */
+const EngineEntry ENGINES[] =
+{
+   { "compute", NULL },
+   { "table", NULL },
+   { "gather", "avx2" },
+   { "colsum", NULL },
+   { "colsum-table", NULL },
+   { "colsum-gather", "avx2" },
+   { "byte-avx512", "avx512bw" },
+   { "bitslice", NULL },
+};
+const int NUM_ENGINES = sizeof(ENGINES) / sizeof(ENGINES[0]);
+
+/* CPU features that engines may need, as cpuHas knows them. */
+const char *const CPU_FEATURES[] = { "sse4.2", "avx2", "avx512f", "avx512bw" };
+const int NUM_CPU_FEATURES = sizeof(CPU_FEATURES) / sizeof(CPU_FEATURES[0]);
+
+/**
+ * Finds the kernel for a rule and engine. Whether the CPU supports the
+ * engine is up to the caller.
+ *
+ * @param engine
+ *           is the name of the engine, as listed in ENGINES
+ * @return the kernel, or NULL if the engine does not exist in this build
+ */
+template <class Rule>
+LifeKernel ruleKernel(const char *engine)
+{
+   static_assert(Rule::vegMax < 16, "CELLS_MAX needs cells below 16");
+
+   if (strcmp(engine, "compute") == 0)
+      return gameOfLife<FusedSum, ComputeUpdate<Rule> >;
+   if (strcmp(engine, "table") == 0)
+      return gameOfLife<DirectSum, TableUpdate<Rule> >;
+   if (strcmp(engine, "colsum") == 0)
+      return gameOfLife<ColumnSum, ComputeUpdate<Rule> >;
+   if (strcmp(engine, "colsum-table") == 0)
+      return gameOfLife<ColumnSum, TableUpdate<Rule> >;
+   if (strcmp(engine, "bitslice") == 0)
+      return sliceLife<Rule>;
+# ifdef HAVE_X86_SIMD
+   if (strcmp(engine, "gather") == 0)
+      return gameOfLife<DirectSum, GatherUpdate<Rule> >;
+   if (strcmp(engine, "colsum-gather") == 0)
+      return gameOfLife<ColumnSum, GatherUpdate<Rule> >;
+   if (strcmp(engine, "byte-avx512") == 0)
+      return byteLife<Rule>;
+# endif
+   return NULL;
+}
+
+/**
+ * Rule variants that can be chosen at launch with "-rule <name>". To explore
+ * a new variant, add a GrowthRule typedef above and an entry here.
+ */
+struct RuleEntry
+{
+   const char *name;
+   LifeKernel (*kernel)(const char*); /* kernel for a given engine */
+};
+
+const RuleEntry RULES[] =
+{
+   { "standard", ruleKernel<StandardRule> },
+};
+const int NUM_RULES = sizeof(RULES) / sizeof(RULES[0]);
+
+/**
+ * Per-simulation results held by one rank until the end of the run, one
+ * array per column of the records file.
+ */
+struct SimulationRecords
+{
+   int count; /* number of records this rank holds */
+   int capacity; /* number of records there is room for */
+   double *wallTime; /* seconds spent initializing and simulating */
+   int32_t *simulation; /* simulation number */
+   int32_t *seed; /* seed the grid was initialized with */
+   int32_t *steps; /* number of steps run */
+   int32_t *vegetation; /* final amount of vegetation */
+   uint8_t *outcome; /* OUTCOME_DIED, OUTCOME_UNSETTLED or OUTCOME_STABLE */
+};
+
+/**
+ * Header of a records file. The header is followed by the columns of
+ * SimulationRecords, in the order they are declared there, each numRecords
+ * entries long, up to the highest simulation that ran. Record k is
+ * simulation k + 1, or all zeros if an early stop meant simulation k + 1
+ * never ran. Each column is padded with zeros to a multiple of 8 bytes, so
+ * every column starts on an 8-byte boundary and a reader can map the file
+ * and use each column as a plain array.
+ */
+struct RecordFileHeader
+{
+   char magic[8]; /* "LIFEREC1" */
+   int32_t numColumns; /* 6 */
+   int32_t nx; /* x dimension of the grids */
+   int32_t ny; /* y dimension of the grids */
+   int32_t seed0; /* random number seed given as input */
+   int32_t maxSteps; /* max # timesteps simulated */
+   int32_t reserved; /* always 0 */
+   int64_t numRecords; /* number of entries in each column */
+   double prob; /* population probability */
+};
+
+/**
+ * Buffer for the per-simulation lines a rank prints. Lines are collected here
+ * and written to stdout in blocks of whole lines, so MPI's stdout forwarding
+ * sees one write per 25 or so simulations instead of one per simulation.
+ * Blocks are kept to 1 KB because the launcher reads each rank's pipe or pty
+ * in chunks of about that size. Larger blocks get cut mid-line, and the
+ * pieces interleave with other ranks' lines.
+ */
+struct RankLog
+{
+   size_t used; /* bytes waiting to be written */
+   char data[LOG_BUFFER_SIZE]; /* the waiting bytes */
+};
+
+RankLog rankLog; /* this rank's log */
+
+/**
+ * Outcome counts that the master collects from every rank.
+ */
+struct CampaignTally
+{
    int ndied; /* # populations which die out */
    int nunsettled; /* # populations which don't stabilize */
    int nstable; /* # populations which do stabilize */
-   float totStepsStable; /* total/average steps to stabilization */
-   float totVegStable; /* total/average stable vegetation */
-   double prob; /* population probability */
-   int seed, seed0; /* random number seeds */
-   int i, j; /* loop counters */
-   void initializeGrid(int[][MAX_Y + 2], int, int, int, double);
-   int gameOfLife(int[][MAX_Y + 2], int, int, int, int, int*);
+};
+
+/**
+ * Streaming summary of one quantity over any number of simulations. The
+ * values are whole numbers, and the summary keeps their sum and the sum of
+ * their squares exactly, the latter in two 64-bit words. Quantiles come
+ * from a log-bucketed sketch: bucket b counts values in
+ * (SKETCH_GAMMA^(b-1), SKETCH_GAMMA^b], so every quantile is within 1% of a
+ * value that was added. Every field is exact, so summaries merge into the
+ * same bits in any order, which is what makes the results independent of
+ * how the simulations were spread over ranks.
+ */
+struct StreamStats
+{
+   int64_t count; /* number of values added */
+   int64_t sum; /* sum of the values */
+   uint64_t squares[2]; /* sum of the squares, low word first */
+   double min; /* smallest value */
+   double max; /* largest value */
+   int64_t zeros; /* number of values that were 0 */
+   int64_t buckets[SKETCH_BUCKETS]; /* counts of positive values */
+};
+
+/**
+ * Distributions a rank keeps of its simulations' results, reduced into the
+ * master's at the end of the run.
+ */
+struct SimulationStats
+{
+   StreamStats steps; /* steps run, for every simulation */
+   StreamStats stableSteps; /* steps to stabilization */
+   StreamStats stableVegetation; /* stable vegetation */
+};
+
+/**
+ * Receives posted by a coordinator for its senders' result blocks. Two
+ * receives are kept posted for every sender, so a sender's next block can
+ * land while the coordinator's rank is still simulating or tallying the
+ * last one.
+ */
+struct ResultInbox
+{
+   MPI::Intracomm comm; /* communicator the blocks travel on */
+   int firstRank; /* rank of the first sender */
+   int numRequests; /* two per sender */
+   int active; /* senders that have not sent their last block */
+   CampaignTally *blocks; /* one block per request */
+   bool *done; /* whether each sender has sent its last block */
+   MPI::Request *requests; /* the posted receives */
+   MPI::Status *statuses; /* statuses of completed receives */
+   int *indices; /* indices of completed receives */
+};
+
+/**
+ * Double-buffered blocks of outcome counts on their way to a coordinator.
+ * One block fills while the other is being sent, so the sender never waits
+ * for the network unless the coordinator falls a whole block behind. Only
+ * counts travel, never per-simulation results, so a block is the same
+ * few bytes however many simulations it covers.
+ */
+struct ResultOutbox
+{
+   MPI::Intracomm comm; /* communicator the blocks travel on */
+   int blockSize; /* simulations in a full block */
+   int current; /* block being filled */
+   CampaignTally blocks[2]; /* the two blocks */
+   MPI::Request requests[2]; /* sends of the two blocks */
+};
+
+/**
+ * The ranks that results travel up through and stops travel down through.
+ * Ranks are split into groups, normally one per node. Each group's leader
+ * collects its members' blocks over shared memory and passes the group's
+ * counts on to the master, which collects only the leaders' blocks. With
+ * a single group the leader is the master and there is no second level.
+ */
+struct AggregationTree
+{
+   MPI::Intracomm group; /* this rank's group, led by its rank 0 */
+   MPI::Intracomm groupBlocks; /* duplicate of group for result blocks */
+   MPI::Intracomm leaders; /* the group leaders, or COMM_NULL */
+   MPI::Intracomm leaderBlocks; /* duplicate of leaders for result blocks */
+   int numGroups; /* number of groups, known to the leaders */
+};
+
+/**
+ * Memory shared by the ranks of one node, in an MPI-3 shared window owned
+ * by the node's rank 0. It holds the batch of simulations the node has
+ * claimed, so most claims are one atomic operation in shared memory, and
+ * the read-only inputs every rank would otherwise load a copy of. The
+ * atomics are used from several processes, so they must be lock free.
+ */
+struct NodeShare
+{
+   MPI_Comm comm; /* ranks on this node */
+   int rank; /* rank in comm */
+   int size; /* number of ranks on this node */
+   MPI_Win win; /* window over the shared segment */
+   std::atomic<uint64_t> *batch; /* next and end of the node's claimed */
+                                 /* simulations, next in the high half */
+   std::atomic<int> *refill; /* NODE_BATCH_READY, NODE_BATCH_REFILLING or */
+                             /* NODE_BATCH_DONE */
+   uint8_t *landscape; /* terrain mask, or NULL */
+   uint8_t *tiles; /* probability map raster, or NULL */
+};
+
+/**
+ * The counter nodes claim batches of a single-point campaign's simulations
+ * from. It lives in an RMA window on the master, and a claim is one
+ * MPI_Fetch_and_op on it, so no rank's CPU is involved in handing out work.
+ * The node's ranks then share out each batch through their NodeShare.
+ * Simulation numbers alone give the seeds, so any rank can run any
+ * simulation.
+ */
+struct WorkCounter
+{
+   MPI_Win win; /* window over the counter */
+   int *next; /* the counter, on the master only */
+   int total; /* number of simulations to hand out */
+   int chunk; /* number of simulations in a node's claim */
+};
+
+/**
+ * One level of collecting a single-point campaign's results. A coordinator
+ * takes blocks from its senders and sends them stops. At the top of the
+ * tree it decides when to stop. Below the top it is a relay: it passes the
+ * counts on to the coordinator above and passes down the stop it gets from
+ * there. A coordinator either runs inline, stepped between its rank's own
+ * simulations, or in a thread of its own. In a thread it takes blocks from
+ * its own rank as well, so that rank simulates at full speed and the
+ * senders are answered while it does.
+ */
+struct Coordinator
+{
+   ResultInbox inbox; /* receives for the result blocks */
+   MPI::Intracomm stops; /* communicator the senders wait for stops on */
+   CampaignTally tally; /* counts so far, or not yet passed on by a relay */
+   bool local; /* whether the rank's own results are still to come */
+   bool relay; /* whether there is a coordinator above */
+   ResultOutbox up; /* blocks to the coordinator above */
+   MPI::Intracomm upStops; /* communicator the stop from above comes on */
+   bool closed; /* whether a relay has sent its last block */
+   double precision; /* wanted CI half width in percent, 0 to run all */
+   double z; /* normal quantile for the confidence level */
+   bool stopped; /* whether the campaign has been stopped early */
+   bool done; /* whether every sender has had its last block and stop */
+};
+
+/**
+ * One point of a parameter sweep, with what the scheduler has learned about
+ * it. The cost of a simulation is taken to be its area times its steps, so
+ * points on big grids, or near the critical probability where grids take
+ * long to settle, are the expensive ones.
+ */
+struct SweepPoint
+{
+   int nx; /* x dimension of the grids */
+   int ny; /* y dimension of the grids */
+   double prob; /* population probability */
+   int nsims; /* number of simulations to perform */
+   int firstNumber; /* simulation numbers of the point follow this one */
+   int handedOut; /* simulations handed out so far */
+   int finished; /* simulations whose results are in */
+   double stepsFinished; /* total steps of the finished simulations */
+   bool stopped; /* whether the point is known precisely enough */
+   CampaignTally tally; /* outcomes of the finished simulations */
+   SimulationStats stats; /* distributions of the finished simulations */
+};
+
+/**
+ * Weights in [0, 1] that scale the population probability cell by cell. The
+ * probability of a cell is prob times its weight, so a map composes with
+ * whatever prob is given. The constant map gives every cell weight 1, which
+ * is the same as having no map. The gradient map changes the weight linearly
+ * from the first row to the last. The file map reads weights from a raster
+ * scaled to 0..255. Each raster value covers a tile of cells, so the raster
+ * may be coarser than the grid.
+ */
+struct ProbabilityMap
+{
+   int kind; /* PROB_CONSTANT, PROB_GRADIENT or PROB_FILE */
+   double from; /* gradient weight of the first row */
+   double to; /* gradient weight of the last row */
+   const char *path; /* weight raster for PROB_FILE */
+   int rows; /* number of raster rows */
+   int cols; /* number of raster columns */
+   uint8_t *tiles; /* rows * cols raster values */
+   int *tileOfColumn; /* raster column covering each grid column 1..ny */
+   double weightOf[256]; /* weight of each raster value */
+};
+
+/**
+ * Options given on the command line. Every process parses the same argv, so
+ * they do not need to be sent from the master.
+ */
+struct Options
+{
+   const char *ruleName; /* name of the growth rule to simulate */
+   const char *engineName; /* name of the engine that applies the rule */
+   const char *tuneCache; /* file of engines "-engine auto" has picked */
+   const char *pinPolicy; /* "none", "compact" or "scatter" */
+   const char *recordsPath; /* records file to write, or NULL */
+   const char *seriesPath; /* prefix of the series files, or NULL */
+   SnapshotWriter snapshots; /* snapshot settings; prefix NULL for none */
+   const char *initPath; /* snapshot to start every simulation from */
+   const char *landscapePath; /* terrain mask raster, or NULL */
+   const char *sweepPath; /* sweep of points to run, or NULL */
+   int verifyCases; /* number of engine checks to run, 0 to simulate */
+   ProbabilityMap probMap; /* spatial variation of the probability */
+   int verbosity; /* VERBOSE_NONE, VERBOSE_SUMMARY or VERBOSE_SIM */
+   bool details; /* add the CPU, arena and distribution lines, which only */
+                 /* an explicit -verbose asks for */
+   bool coordinatorThread; /* coordinate in a thread of the master's own */
+   const char *aggregate; /* "flat", "node" or a number of ranks per group */
+   double precision; /* wanted CI half width in percent, 0 to run all */
+   double confidence; /* confidence level of the intervals in percent */
+   int checkEvery; /* simulations between progress reports */
+};
+
+
+/**
+ * Main method to run the game of life, using the MPI.
+ */
+int main(int argc, char *argv[])
+{
+   // Variables
+
+   int mySimsToRun;
+   WorkCounter work; /* where simulations are claimed from */
+   int claim; /* index of a claimed simulation */
+   int simulationNumber;
+   const int MASTER = 0;
+   const int NX_TAG = 1;
+   const int NY_TAG = 2;
+   const int PROB_TAG = 3;
+   const int NSIMS_TAG = 4;
+   const int SEED0_TAG = 5;
+
+   int *grid; /* grid of vegetation values */
+   int nx; /* x dimension of grid */
+   int ny; /* y dimension of grid */
+   int maxSteps; /* max # timesteps to simulate */
+   int vegies; /* amount of stable vegetation */
+   int nsteps; /* number of steps actually run */
+   int nsims; /* number of simulations to perform */
+   int simsRun; /* number of simulations that actually ran */
+   int lastRecord; /* highest simulation number run, then over all ranks */
+   NodeShare node; /* memory shared with the ranks of this node */
+   AggregationTree tree; /* the ranks results travel up through */
+   Coordinator coordinator; /* a group leader's collection of results */
+   Coordinator top; /* the master's collection of the leaders' results */
+   Coordinator *topOrNull; /* &top if this rank has it, else NULL */
+   Coordinator *root; /* the coordinator at the top of the tree */
+   std::thread coordinatorThread; /* runs the coordinators, if threaded */
+   bool threaded; /* whether coordinators have a thread of their own */
+   int failures; /* engine runs that failed verification */
+   bool leader; /* whether this rank leads its group */
+   bool sendsResults; /* whether this rank sends result blocks */
+   CampaignTally outcome; /* outcome of one simulation */
+   SimulationStats groupStats; /* distributions of the group's results */
+   int threadLevel; /* thread support MPI provides */
+   SimulationStats stats; /* distributions of this rank's results */
+   SimulationStats totals; /* distributions of every rank's results */
+   MPI::Datatype statsType; /* one SimulationStats */
+   MPI::Op statsOp; /* merges SimulationStats */
+   ResultOutbox outbox; /* this rank's result blocks */
+   int result[2]; /* vegetation and step results of one simulation */
+   bool adaptive; /* whether the campaign may stop early */
+   bool stopped; /* whether the campaign has been stopped */
+   double prob; /* population probability */
+   int seed, seed0; /* random number seeds */
+   int i; /* loop counter */
+   void parseOptions(int, char*[], Options*);
+   LifeKernel findKernel(const char*, const char*);
+   bool cpuHas(const char*);
+   LifeKernel tuneKernel(const Options*, int, int, double, int);
+   bool pinThread(const char*, int);
+   size_t gridBytes(int, int);
+   size_t slotBytes(int, int);
+   int poolSlots(const Options*);
+   void arenaCreate(GridArena*, size_t);
+   void *arenaAllocate(GridArena*, size_t);
+   void arenaDestroy(GridArena*);
+   void poolCreate(GridPool*, GridArena*, size_t, int);
+   int *poolAcquire(GridPool*);
+   void poolRelease(GridPool*, int*);
+   int classifySimulation(int, int, int);
+   int simulationSeed(int, int);
+   void tallyResults(CampaignTally*, const int*, int, int);
+   void tallyAdd(CampaignTally*, const CampaignTally*);
+   void statsClear(SimulationStats*);
+   void treeCreate(AggregationTree*, const char*, int);
+   void treeDestroy(AggregationTree*);
+   void coordinatorCreate(Coordinator*, int, MPI::Intracomm&,
+         MPI::Intracomm&, const Options*);
+   void coordinatorLink(Coordinator*, int, MPI::Intracomm&, MPI::Intracomm&);
+   int coordinatorStep(Coordinator*);
+   void coordinatorsFinish(Coordinator*, Coordinator*);
+   void coordinatorDestroy(Coordinator*);
+   void outboxCreate(ResultOutbox*, int, MPI::Intracomm&);
+   bool outboxAdd(ResultOutbox*, const CampaignTally*);
+   void outboxFinish(ResultOutbox*);
+   void statsAdd(SimulationStats*, int, int, int);
+   void statsMerge(const void*, void*, int, const MPI::Datatype&);
+   int runSimulation(LifeKernel, int*, int, int, double, int, int,
+         const uint8_t*, const Options*, StepHooks*, int*);
+   void printSummary(const CampaignTally*, const SimulationStats*, int,
+         bool);
+   void runSweep(LifeKernel, Options*, int, int, bool);
+   int runVerify(int, int, int);
+   void logFlush(RankLog*);
+   void seriesCreate(SeriesRecorder*, const char*, int);
+   void seriesDestroy(SeriesRecorder*);
+   void rasterLoad(const char*, int, int, int, int, uint8_t*);
+   void probabilityMapSize(ProbabilityMap*, int, int);
+   void probabilityMapDestroy(ProbabilityMap*);
+   void nodeShareCreate(NodeShare*, size_t, size_t, int);
+   void nodeShareReady(NodeShare*);
+   void nodeShareDestroy(NodeShare*);
+   void workCreate(WorkCounter*, int, int, int);
+   bool workClaim(WorkCounter*, int*, int*);
+   bool nodeClaim(NodeShare*, WorkCounter*, int*);
+   void workDestroy(WorkCounter*);
+   uint8_t *landscape; /* terrain mask, nx * ny values, or NULL */
+   SeriesRecorder series; /* this rank's vegetation time series */
+   StepHooks hooks; /* observers for the kernel */
+   void recordsCreate(SimulationRecords*, int);
+   void recordsReserve(SimulationRecords*, int);
+   void recordsWrite(SimulationRecords*, const char*, RecordFileHeader*);
+   void recordsDestroy(SimulationRecords*);
+   SimulationRecords records; /* this rank's per-simulation results */
+   RecordFileHeader recordHeader; /* description of the records file */
+   double startTime; /* wall clock time at the start of a simulation */
+   Options options; /* command line options */
+   LifeKernel kernel; /* simulation kernel for the chosen rule */
+   bool autoEngine; /* whether to pick the fastest engine */
+
+   MPI::Status status;
+   int myId;
+   int numProcs;
+
+   //*** Initialize MPI, get rank and size
+   threadLevel = MPI::Init_thread(argc, argv, MPI::THREAD_MULTIPLE);
+   numProcs = MPI::COMM_WORLD.Get_size();
+   myId = MPI::COMM_WORLD.Get_rank();
+
+   // Pick the growth rule and engine before any input is read, so that a bad
+   // name is reported right away. With "-engine auto" the engine is picked
+   // once the grid size is known, and the reference engine stands in until
+   // then.
+   parseOptions(argc, argv, &options);
+   autoEngine = strcmp(options.engineName, "auto") == 0;
+   kernel = findKernel(options.ruleName,
+         autoEngine ? "compute" : options.engineName);
+   if (kernel == NULL)
+   {
+      if (myId == MASTER)
+      {
+         fprintf(stderr, "Unknown or unsupported rule/engine \"%s\"/\"%s\".\n",
+               options.ruleName, options.engineName);
+         fprintf(stderr, "Available rules:");
+         for (i = 0; i < NUM_RULES; i++)
+            fprintf(stderr, " %s", RULES[i].name);
+         fprintf(stderr, "\nAvailable engines: auto");
+         for (i = 0; i < NUM_ENGINES; i++)
+         {
+            fprintf(stderr, " %s", ENGINES[i].name);
+            if (ENGINES[i].feature != NULL)
+               fprintf(stderr, " (%s%s)", ENGINES[i].feature,
+                     cpuHas(ENGINES[i].feature) ? "" : ", not on this CPU");
+         }
+         fprintf(stderr, "\n");
+      }
+      MPI::Finalize();
+      return 1;
+   }
+   if (myId == MASTER && options.verbosity >= VERBOSE_SUMMARY
+         && options.details)
+   {
+      printf("CPU features:");
+      for (i = 0; i < NUM_CPU_FEATURES; i++)
+      {
+         if (cpuHas(CPU_FEATURES[i]))
+            printf(" %s", CPU_FEATURES[i]);
+      }
+      printf("\n");
+   }
+
+   // Pin this rank to a core before the grids are allocated, so that their
+   // pages are first touched on the rank's own NUMA node.
+   if (strcmp(options.pinPolicy, "none") != 0)
+   {
+      MPI_Comm nodeComm; /* ranks sharing this node */
+      int localId; /* rank within the node */
+
+      MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, myId,
+            MPI_INFO_NULL, &nodeComm);
+      MPI_Comm_rank(nodeComm, &localId);
+      MPI_Comm_free(&nodeComm);
+
+      if (!pinThread(options.pinPolicy, localId))
+         fprintf(stderr, "Rank %d: could not apply pinning policy \"%s\"\n",
+               myId, options.pinPolicy);
+   }
+
+   // The master coordinates in a thread of its own if MPI allows it.
+   // Otherwise it coordinates between its own simulations.
+   threaded = options.coordinatorThread && numProcs > 1
+         && threadLevel == MPI::THREAD_MULTIPLE;
+
+   // Verification checks the engines and runs no campaign.
+   if (options.verifyCases > 0)
+   {
+      failures = runVerify(options.verifyCases, myId, numProcs);
+      MPI::Finalize();
+      return failures > 0 ? 1 : 0;
+   }
+
+   // A sweep is scheduled quite differently from a single point.
+   if (options.sweepPath != NULL)
+   {
+      runSweep(kernel, &options, myId, numProcs, threaded);
+      MPI::Finalize();
+      return 0;
+   }
+
+   // Get input parameters in master and send values to all other processors.
+   if (myId == MASTER)
+   {
+       // Output initial greeting from master node.
+       if (options.verbosity >= VERBOSE_SUMMARY)
+          cout << "Processes available is " << numProcs << "\n";
+
+	   nx = 0;
+	   ny = 0;
+
+	   while (nx < 1 || ny < 1 || (long) nx * ny > CELLS_MAX)
+	   {
+		  printf("Enter X and Y dimensions of wilderness: ");
+		  scanf("%d%d", &nx, &ny);
+	   }
+
+	   printf("\nEnter population probability: ");
+	   scanf("%lf", &prob);
+
+	   printf("\nEnter number of simulations: ");
+	   scanf("%d", &nsims);
+
+	   printf("\nEnter random number seed: ");
+	   scanf("%d", &seed0);
+
+	   // Send input variables to all other processors.
+       for (i = 1; i < numProcs; i++)
+       {
+           MPI::COMM_WORLD.Send(&nx, 1, MPI_INTEGER, i, NX_TAG);
+           MPI::COMM_WORLD.Send(&ny, 1, MPI_INTEGER, i, NY_TAG);
+           MPI::COMM_WORLD.Send(&prob, 1, MPI_DOUBLE, i, PROB_TAG);
+           MPI::COMM_WORLD.Send(&nsims, 1, MPI_INTEGER, i, NSIMS_TAG);
+           MPI::COMM_WORLD.Send(&seed0, 1, MPI_INTEGER, i, SEED0_TAG);
+       }
+
+   } // if
+   else
+   {
+	   // Receive input variables from master node.
+	   MPI::COMM_WORLD.Recv(&nx, 1, MPI::INTEGER, MASTER, NX_TAG, status);
+	   MPI::COMM_WORLD.Recv(&ny, 1, MPI::INTEGER, MASTER, NY_TAG, status);
+	   MPI::COMM_WORLD.Recv(&prob, 1, MPI::DOUBLE, MASTER, PROB_TAG, status);
+	   MPI::COMM_WORLD.Recv(&nsims, 1, MPI::INTEGER, MASTER, NSIMS_TAG, status);
+	   MPI::COMM_WORLD.Recv(&seed0, 1, MPI::INTEGER, MASTER, SEED0_TAG, status);
+   }
+
+   //*** Common Code to be executed to all nodes
+
+   // Set up this rank's grid pool, sized for the largest grid in the job, in
+   // a fresh arena, and take the grid from it.
+   arenaCreate(&gridArena, poolSlots(&options) * slotBytes(nx, ny));
+   poolCreate(&gridPool, &gridArena, slotBytes(nx, ny), poolSlots(&options));
+   grid = poolAcquire(&gridPool);
+   if (myId == MASTER && options.verbosity >= VERBOSE_SUMMARY
+         && options.details)
+      printf("\nGrid arena of %lu KB per process uses %s pages\n",
+            (unsigned long) (gridArena.size >> 10), gridArena.pages);
+   if (autoEngine)
+      kernel = tuneKernel(&options, nx, ny, prob, myId);
+
+   // Decide how many simulations each proc needs to run. Ranks claim them
+   // as they go, so this is only each rank's share on average, and the
+   // left over simulations are claimed like any others.
+   mySimsToRun = nsims / numProcs;
+   hooks.series = NULL;
+   if (options.seriesPath != NULL)
+   {
+      seriesCreate(&series, options.seriesPath, myId);
+      hooks.series = &series;
+   }
+   hooks.snapshots = NULL;
+   if (options.snapshots.prefix != NULL)
+      hooks.snapshots = &options.snapshots;
+   hooks.trace = NULL;
+
+   // Rank 0 of each node streams the landscape and the probability map
+   // raster straight from their files into the node's shared window, and
+   // the node's other ranks read them from there. In this batch mode each
+   // rank simulates whole grids, so it needs all of the rows.
+   probabilityMapSize(&options.probMap, nx, ny);
+   nodeShareCreate(&node,
+         options.landscapePath != NULL ? (size_t) nx * ny : 0,
+         options.probMap.kind == PROB_FILE
+               ? (size_t) options.probMap.rows * options.probMap.cols : 0,
+         myId);
+   landscape = node.landscape;
+   options.probMap.tiles = node.tiles;
+   if (node.rank == 0 && landscape != NULL)
+      rasterLoad(options.landscapePath, nx, ny, 0, nx, landscape);
+   if (node.rank == 0 && options.probMap.tiles != NULL)
+      rasterLoad(options.probMap.path, options.probMap.rows,
+            options.probMap.cols, 0, options.probMap.rows,
+            options.probMap.tiles);
+   nodeShareReady(&node);
+   workCreate(&work, nsims, numProcs, node.size);
+   if (options.recordsPath != NULL)
+      recordsCreate(&records, mySimsToRun);
+
+   // Ranks send the outcome counts of every options.checkEvery simulations
+   // to their group leader without waiting for them to arrive. Leaders
+   // collect them between their own simulations, and pass their group's
+   // counts on to the master in blocks as many times bigger as the group
+   // has ranks. In an adaptive campaign the master stops the campaign once
+   // the confidence intervals of all three outcome percentages are narrow
+   // enough. The stop is passed down the tree, and every rank gets exactly
+   // one STOP_TAG message, either when the campaign stops or after its last
+   // results.
+   adaptive = options.precision > 0;
+   stopped = false;
+   maxSteps = STEPS_MAX;
+   treeCreate(&tree, options.aggregate, myId);
+   leader = tree.group.Get_rank() == 0;
+   topOrNull = NULL;
+   root = &coordinator;
+   if (leader)
+   {
+      coordinatorCreate(&coordinator, threaded ? 0 : 1, tree.groupBlocks,
+            tree.group, &options);
+      if (tree.numGroups > 1)
+      {
+         coordinatorLink(&coordinator,
+               options.checkEvery * tree.group.Get_size(), tree.leaderBlocks,
+               tree.leaders);
+         if (myId == MASTER)
+         {
+            coordinatorCreate(&top, 0, tree.leaderBlocks, tree.leaders,
+                  &options);
+            topOrNull = &top;
+            root = &top;
+         }
+      }
+      if (threaded)
+         coordinatorThread = std::thread(coordinatorsFinish, &coordinator,
+               topOrNull);
+   }
+   sendsResults = !leader || threaded;
+   if (sendsResults)
+      outboxCreate(&outbox, options.checkEvery, tree.groupBlocks);
+   statsClear(&stats);
+
+   // Until the campaign's simulations run out, claim the next of the
+   // node's batch, run it and record the results.
+   while (!stopped)
+   {
+      if (!nodeClaim(&node, &work, &claim))
+         break;
+      if (options.recordsPath != NULL)
+         recordsReserve(&records, records.count + 1);
+
+      // Compute which simulation this is, so that the number can be used in
+      // getting the seed. This replaces the "i" value in other versions.
+      simulationNumber = claim + 1;
+
+      // Run a simulation and remember the vegetation and step results.
+      startTime = MPI::Wtime();
+      seed = simulationSeed(seed0, simulationNumber);
+      nsteps = runSimulation(kernel, grid, nx, ny, prob, seed,
+            simulationNumber, landscape, &options, &hooks, &vegies);
+      statsAdd(&stats, vegies, nsteps, maxSteps);
+
+      if (options.recordsPath != NULL)
+      {
+         i = records.count;
+         records.wallTime[i] = MPI::Wtime() - startTime;
+         records.simulation[i] = simulationNumber;
+         records.seed[i] = seed;
+         records.steps[i] = nsteps;
+         records.vegetation[i] = vegies;
+         records.outcome[i] = classifySimulation(vegies, nsteps, maxSteps);
+         records.count = i + 1;
+      }
+
+      // Pass the results on, and find out whether the campaign is done.
+      result[NVEGIES_INDEX] = vegies;
+      result[NSTEPS_INDEX] = nsteps;
+      memset(&outcome, 0, sizeof(outcome));
+      tallyResults(&outcome, result, 1, maxSteps);
+      if (sendsResults)
+      {
+         if (outboxAdd(&outbox, &outcome) && adaptive
+               && tree.group.Iprobe(0, STOP_TAG))
+         {
+            tree.group.Recv(NULL, 0, MPI::INTEGER, 0, STOP_TAG);
+            stopped = true;
+         }
+      }
+      else
+      {
+         tallyAdd(&coordinator.tally, &outcome);
+         coordinatorStep(&coordinator);
+         if (topOrNull != NULL)
+            coordinatorStep(topOrNull);
+         stopped = coordinator.stopped;
+      }
+   } // for
+
+   //*** Separation of manager/worker code
+   if (sendsResults)
+   {
+      // Code for worker, and for a leader's simulations when it has a
+      // coordinator thread:
+      outboxFinish(&outbox);
+      if (adaptive && !stopped)
+         tree.group.Recv(NULL, 0, MPI::INTEGER, 0, STOP_TAG);
+   }
+   if (leader)
+   {
+      // Code for group leaders, the master among them:
+
+      // The leader's own results are in. Wait for the rest of the blocks.
+      if (threaded)
+         coordinatorThread.join();
+      else
+      {
+         coordinator.local = false;
+         coordinatorsFinish(&coordinator, topOrNull);
+      }
+      coordinatorDestroy(&coordinator);
+      if (topOrNull != NULL)
+         coordinatorDestroy(topOrNull);
+   }
+   simsRun = nsims;
+   if (myId == MASTER)
+   {
+      // Code for master:
+
+      // An early stop leaves fewer simulations than were asked for, and the
+      // percentages are of those that ran. Only the master knows this, so
+      // the count is kept apart from nsims, which every rank shares.
+      stopped = root->stopped;
+      if (stopped)
+         simsRun = root->tally.ndied + root->tally.nunsettled
+               + root->tally.nstable;
+   } // if
+
+   // Combine the distributions within each group, then the groups' in the
+   // master.
+   statsType = MPI::BYTE.Create_contiguous(sizeof(SimulationStats));
+   statsType.Commit();
+   statsOp.Init(statsMerge, true);
+   tree.group.Reduce(&stats, &groupStats, 1, statsType, statsOp, 0);
+   if (leader)
+      tree.leaders.Reduce(&groupStats, &totals, 1, statsType, statsOp, 0);
+   statsOp.Free();
+   statsType.Free();
+   treeDestroy(&tree);
+
+   logFlush(&rankLog);
+   workDestroy(&work);
+   nodeShareDestroy(&node);
+   options.probMap.tiles = NULL; /* it was in the node's window */
+   probabilityMapDestroy(&options.probMap);
+   if (hooks.series != NULL)
+      seriesDestroy(hooks.series);
+
+   // Every rank writes its own part of the records file in parallel. The
+   // writes are collective, so every rank needs the same record count: up
+   // to the highest simulation any rank ran.
+   if (options.recordsPath != NULL)
+   {
+      lastRecord = 0;
+      for (i = 0; i < records.count; i++)
+      {
+         if (records.simulation[i] > lastRecord)
+            lastRecord = records.simulation[i];
+      }
+      memset(&recordHeader, 0, sizeof(recordHeader));
+      memcpy(recordHeader.magic, "LIFEREC1", 8);
+      recordHeader.numColumns = 6;
+      recordHeader.nx = nx;
+      recordHeader.ny = ny;
+      recordHeader.seed0 = seed0;
+      recordHeader.maxSteps = STEPS_MAX;
+      MPI::COMM_WORLD.Allreduce(MPI::IN_PLACE, &lastRecord, 1, MPI::INT,
+            MPI::MAX);
+      recordHeader.numRecords = lastRecord;
+      recordHeader.prob = prob;
+      recordsWrite(&records, options.recordsPath, &recordHeader);
+      recordsDestroy(&records);
+   }
+
+
+   poolRelease(&gridPool, grid);
+   arenaDestroy(&gridArena);
+
+   //*** Shut down MPI.
+   MPI::Finalize();
+
+   //*** Display results
+   if (myId == MASTER && options.verbosity >= VERBOSE_SUMMARY)
+   {
+      if (stopped)
+         printf("Stopped early after %d simulations\n", simsRun);
+      printSummary(&root->tally, &totals, simsRun, options.details);
+   }
+
+} // main
+
+
+/**
+  * Runs one simulation: initializes the grid from the options, runs the
+  * kernel, and passes the final grid and results to the hooks and the log.
+  *
+  * @param kernel
+  *           is the simulation kernel
+  * @param grid
+  *           is the grid to simulate on
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @param prob
+  *           is the population probability
+  * @param seed
+  *           is the seed the grid is initialized with
+  * @param simulationNumber
+  *           is the number of the simulation in the job
+  * @param landscape
+  *           is the terrain mask for the grid size, or NULL
+  * @param options
+  *           is the command line options
+  * @param hooks
+  *           is the observers for the kernel
+  * @param pvegies
+  *           is where the final amount of vegetation is stored
+  * @return the number of steps run
+  */
+int runSimulation(LifeKernel kernel, int *grid, int nx, int ny, double prob,
+      int seed, int simulationNumber, const uint8_t *landscape,
+      const Options *options, StepHooks *hooks, int *pvegies)
+{
+   int nsteps; /* number of steps actually run */
+   void initializeGrid(int*, int, int, int, double, const uint8_t*,
+         const ProbabilityMap*);
+   void snapshotRead(const char*, int*, int, int);
+   void snapshotWrite(SnapshotWriter*, const int*, int, int, int);
+   void seriesPush(SeriesRecorder*, int32_t);
+   void logPrintf(RankLog*, const char*, ...);
+
+   // Initialize the grid values using the given probability, or from the
+   // given snapshot.
+   if (options->initPath != NULL)
+      snapshotRead(options->initPath, grid, nx, ny);
+   else
+      initializeGrid(grid, nx, ny, seed, prob, landscape, &options->probMap);
+
+   if (hooks->snapshots != NULL)
+      hooks->snapshots->simulation = simulationNumber;
+   nsteps = kernel(grid, nx, ny, STEPS_MAX, UNCHANGED_MAX, pvegies, hooks);
+   if (hooks->series != NULL)
+      seriesPush(hooks->series, -simulationNumber);
+   if (hooks->snapshots != NULL && hooks->snapshots->final)
+      snapshotWrite(hooks->snapshots, grid, nx, ny, nsteps);
+
+   if (options->verbosity >= VERBOSE_SIM)
+      logPrintf(&rankLog, "Number of time steps = %d, Vegetation total = %d\n",
+            nsteps, *pvegies);
+   return nsteps;
+} // runSimulation
+
+
+/**
+  * Prints the outcome percentages and the distributions of a campaign.
+  *
+  * @param tally
+  *           is the outcome counts
+  * @param stats
+  *           is the distributions
+  * @param nsims
+  *           is the number of simulations the percentages are of
+  * @param details
+  *           is whether to print the distributions as well
+  */
+void printSummary(const CampaignTally *tally, const SimulationStats *stats,
+      int nsims, bool details)
+{
+   double streamMean(const StreamStats*);
+   double streamStdDev(const StreamStats*);
+   double streamQuantile(const StreamStats*, double);
+   const StreamStats *const shown[2] =
+         { &stats->stableSteps, &stats->stableVegetation };
+   const char *const names[2] = { "steps:     ", "vegetation:" };
+   int i; /* loop counter */
+
+   printf("Percentage which died out: %g%%\n", 100.0 * tally->ndied / nsims);
+   printf("Percentage unsettled:      %g%%\n",
+         100.0 * tally->nunsettled / nsims);
+   printf("Percentage stabilized:     %g%%\n", 100.0 * tally->nstable / nsims);
+   printf("  Of which:\n");
+   printf("  Average steps:           %g\n", streamMean(&stats->stableSteps));
+   printf("  Average vegetation:      %g\n",
+         streamMean(&stats->stableVegetation));
+   if (details && stats->stableSteps.count > 0)
+   {
+      printf("  Distribution (sd, min, median, p90, p99, max) of\n");
+      for (i = 0; i < 2; i++)
+      {
+         printf("    %s %g, %g, %g, %g, %g, %g\n", names[i],
+               streamStdDev(shown[i]), shown[i]->min,
+               streamQuantile(shown[i], 0.5), streamQuantile(shown[i], 0.9),
+               streamQuantile(shown[i], 0.99), shown[i]->max);
+      }
+   }
+} // printSummary
+
+
+/**
+  * Reads a sweep file. Each line holds the X and Y dimensions, population
+  * probability and number of simulations of one point. Blank lines and
+  * lines starting with # are skipped.
+  *
+  * @param path
+  *           is the sweep file
+  * @param points
+  *           is where the new array of points is stored
+  * @return the number of points, or 0 if the file could not be read
+  */
+int sweepRead(const char *path, SweepPoint **points)
+{
+   FILE *file; /* the sweep file */
+   char line[256]; /* line being read */
+   int numPoints = 0; /* points read so far */
+   int capacity = 16; /* size of the array */
+   SweepPoint point; /* point being read */
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      perror(path);
+      return 0;
+   }
+
+   *points = new SweepPoint[capacity];
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      char first = 0; /* first character that is not a space */
+
+      if (sscanf(line, " %c", &first) < 1 || first == '#')
+         continue;
+      memset(&point, 0, sizeof(point));
+      if (sscanf(line, "%d%d%lf%d", &point.nx, &point.ny, &point.prob,
+            &point.nsims) < 4 || point.nx < 1 || point.ny < 1
+            || (long) point.nx * point.ny > CELLS_MAX || point.nsims < 0)
+      {
+         fprintf(stderr, "%s: bad sweep point \"%s\"\n", path, line);
+         numPoints = 0;
+         break;
+      }
+      if (numPoints == capacity)
+      {
+         SweepPoint *bigger = new SweepPoint[capacity * 2];
+
+         memcpy(bigger, *points, capacity * sizeof(SweepPoint));
+         delete[] *points;
+         *points = bigger;
+         capacity = capacity * 2;
+      }
+      (*points)[numPoints] = point;
+      numPoints = numPoints + 1;
+   }
+   fclose(file);
+
+   if (numPoints == 0)
+   {
+      delete[] *points;
+      *points = NULL;
+   }
+   return numPoints;
+} // sweepRead
+
+
+/**
+  * Estimates the cost of one more simulation of a sweep point. Until any of
+  * its results are in, a point is assumed to run for the full STEPS_MAX.
+  *
+  * @param point
+  *           is the point
+  * @return the estimated number of cell updates
+  */
+double sweepCost(const SweepPoint *point)
+{
+   double steps = STEPS_MAX; /* expected steps per simulation */
+
+   if (point->finished > 0)
+      steps = point->stepsFinished / point->finished + 1;
+   return (double) point->nx * point->ny * steps;
+} // sweepCost
+
+
+/**
+  * Picks the next chunk of a sweep to hand out. Work goes out in longest
+  * processing time order: the point whose simulations are estimated to be
+  * the most expensive comes first. Chunks get smaller as the remaining
+  * work shrinks, to about a SWEEP_CHUNKS_PER_WORKER-th of each worker's
+  * share. Simulations of big grids therefore go out one at a time, early,
+  * and the cheap ones are packed around them in larger chunks that fill in
+  * the end of the job.
+  *
+  * @param points
+  *           is the points of the sweep
+  * @param numPoints
+  *           is the number of points
+  * @param numWorkers
+  *           is the number of ranks running chunks
+  * @param chunk
+  *           is where the point, first simulation index and number of
+  *           simulations of the chunk are stored
+  * @return false if there is no work left to hand out
+  */
+bool sweepNextChunk(SweepPoint *points, int numPoints, int numWorkers,
+      int chunk[3])
+{
+   double remaining = 0; /* estimated cost of the work not handed out */
+   double bestCost = -1; /* cost of a simulation of the best point */
+   double size; /* number of simulations in the chunk */
+   int best = -1; /* the point to take the chunk from */
+   int p; /* loop counter */
+
+   for (p = 0; p < numPoints; p++)
+   {
+      double cost; /* cost of a simulation of this point */
+
+      if (points[p].stopped || points[p].handedOut >= points[p].nsims)
+         continue;
+      cost = sweepCost(&points[p]);
+      remaining = remaining + cost * (points[p].nsims - points[p].handedOut);
+      if (cost > bestCost)
+      {
+         bestCost = cost;
+         best = p;
+      }
+   }
+   if (best < 0)
+      return false;
+
+   size = remaining / ((double) numWorkers * SWEEP_CHUNKS_PER_WORKER)
+         / bestCost;
+   size = size < 1 ? 1 : size > SWEEP_CHUNK_MAX ? SWEEP_CHUNK_MAX : size;
+   if (size > points[best].nsims - points[best].handedOut)
+      size = points[best].nsims - points[best].handedOut;
+
+   chunk[0] = best;
+   chunk[1] = points[best].handedOut;
+   chunk[2] = (int) size;
+   points[best].handedOut = points[best].handedOut + chunk[2];
+   return true;
+} // sweepNextChunk
+
+
+/**
+  * Adds the results of a finished chunk to its sweep point. A point is
+  * stopped once its outcome percentages are precise enough, if -precision
+  * was given.
+  *
+  * @param point
+  *           is the point
+  * @param results
+  *           is count pairs of vegetation and step results
+  * @param count
+  *           is the number of simulations in results
+  * @param precision
+  *           is the wanted CI half width in percent, or 0
+  * @param z
+  *           is the normal quantile of the confidence level
+  */
+void sweepRecord(SweepPoint *point, const int *results, int count,
+      double precision, double z)
+{
+   void tallyResults(CampaignTally*, const int*, int, int);
+   void statsAdd(SimulationStats*, int, int, int);
+   bool campaignPrecise(const CampaignTally*, double, double);
+   int i; /* loop counter */
+
+   tallyResults(&point->tally, results, count, STEPS_MAX);
+   for (i = 0; i < count; i++)
+   {
+      statsAdd(&point->stats, results[(i * 2) + NVEGIES_INDEX],
+            results[(i * 2) + NSTEPS_INDEX], STEPS_MAX);
+      point->stepsFinished = point->stepsFinished
+            + results[(i * 2) + NSTEPS_INDEX];
+   }
+   point->finished = point->finished + count;
+   if (campaignPrecise(&point->tally, precision, z))
+      point->stopped = true;
+} // sweepRecord
+
+
+/**
+  * Hands out the chunks of a sweep to ranks firstRank and up as they ask for
+  * them, and keeps every point's results. Every message from a rank holds
+  * the results of its last chunk and asks for the next one. A chunk of no
+  * simulations tells the rank that the sweep is done.
+  *
+  * @param points
+  *           is the points of the sweep
+  * @param numPoints
+  *           is the number of points
+  * @param firstRank
+  *           is the first rank that runs chunks
+  * @param numProcs
+  *           is the number of processes
+  * @param options
+  *           is the command line options
+  * @param z
+  *           is the normal quantile of the confidence level
+  * @param sleep
+  *           is whether to sleep between polls rather than wait in MPI
+  */
+void sweepSchedule(SweepPoint *points, int numPoints, int firstRank,
+      int numProcs, const Options *options, double z, bool sleep)
+{
+   int results[3 + 2 * SWEEP_CHUNK_MAX]; /* a chunk and its results */
+   int chunk[3]; /* point, first simulation index and count of a chunk */
+   int active; /* ranks still running chunks */
+   MPI::Status status;
+
+   for (active = numProcs - firstRank; active > 0;)
+   {
+      if (sleep)
+      {
+         while (!MPI::COMM_WORLD.Iprobe(MPI::ANY_SOURCE, RESULTS_TAG))
+            usleep(COORDINATOR_POLL_US);
+      }
+      MPI::COMM_WORLD.Recv(results, 3 + 2 * SWEEP_CHUNK_MAX, MPI::INTEGER,
+            MPI::ANY_SOURCE, RESULTS_TAG, status);
+      if (results[2] > 0)
+         sweepRecord(&points[results[0]], results + 3, results[2],
+               options->precision, z);
+      if (!sweepNextChunk(points, numPoints, numProcs - firstRank, chunk))
+      {
+         chunk[2] = 0;
+         active = active - 1;
+      }
+      MPI::COMM_WORLD.Send(chunk, 3, MPI::INTEGER, status.Get_source(),
+            CHUNK_TAG);
+   }
+} // sweepSchedule
+
+
+/**
+  * Runs a sweep over several points in one job. The master reads the sweep
+  * file and hands out chunks of simulations as ranks ask for them, in the
+  * order sweepNextChunk picks, and keeps every point's results. With a
+  * coordinator thread the master runs chunks too. Without one, and with
+  * several ranks, the master only schedules. A lone master schedules its
+  * own chunks.
+  *
+  * @param kernel
+  *           is the simulation kernel
+  * @param options
+  *           is the command line options
+  * @param myId
+  *           is the rank of this process
+  * @param numProcs
+  *           is the number of processes
+  * @param threaded
+  *           is whether the master schedules in a thread of its own
+  */
+void runSweep(LifeKernel kernel, Options *options, int myId, int numProcs,
+      bool threaded)
+{
+   const int MASTER = 0;
+   const int RESULTS_MAX = 3 + 2 * SWEEP_CHUNK_MAX; /* ints in a message */
+
+   SweepPoint *points = NULL; /* the points of the sweep */
+   int numPoints = 0; /* number of points */
+   int seed0; /* random number seed */
+   int chunk[3]; /* point, first simulation index and count of a chunk */
+   int results[RESULTS_MAX]; /* a chunk and the results of its simulations */
+   int *grid; /* grid of vegetation values */
+   uint8_t *landscape = NULL; /* terrain mask for the loaded point */
+   int loadedNx = 0, loadedNy = 0; /* grid size the masks are loaded for */
+   size_t largest = 0; /* largest slot any point needs */
+   int biggest = 0; /* point with the largest slot */
+   SeriesRecorder series; /* this rank's vegetation time series */
+   StepHooks hooks; /* observers for the kernel */
+   double startTime; /* wall clock time at the start of the sweep */
+   double z; /* normal quantile for the confidence level */
+   std::thread scheduler; /* the master's scheduling thread */
+   int p, k; /* loop counters */
+
+   size_t slotBytes(int, int);
+   int poolSlots(const Options*);
+   void arenaCreate(GridArena*, size_t);
+   void arenaDestroy(GridArena*);
+   void poolCreate(GridPool*, GridArena*, size_t, int);
+   int *poolAcquire(GridPool*);
+   void poolRelease(GridPool*, int*);
+   void logFlush(RankLog*);
+   void seriesCreate(SeriesRecorder*, const char*, int);
+   void seriesDestroy(SeriesRecorder*);
+   void rasterLoad(const char*, int, int, int, int, uint8_t*);
+   void probabilityMapLoad(ProbabilityMap*, int, int);
+   void probabilityMapDestroy(ProbabilityMap*);
+   double normalQuantile(double);
+   int simulationSeed(int, int);
+   LifeKernel tuneKernel(const Options*, int, int, double, int);
+
+   // The master reads the points and the seed, and every rank gets a copy.
+   if (myId == MASTER)
+   {
+      numPoints = sweepRead(options->sweepPath, &points);
+      seed0 = 0;
+      if (numPoints > 0)
+      {
+         printf("Enter random number seed: ");
+         scanf("%d", &seed0);
+      }
+      if (options->recordsPath != NULL)
+         fprintf(stderr, "Records are not written for sweeps.\n");
+   }
+   MPI::COMM_WORLD.Bcast(&numPoints, 1, MPI::INTEGER, MASTER);
+   MPI::COMM_WORLD.Bcast(&seed0, 1, MPI::INTEGER, MASTER);
+   if (numPoints == 0)
+      return;
+   if (myId != MASTER)
+      points = new SweepPoint[numPoints];
+   MPI::COMM_WORLD.Bcast(points, numPoints * sizeof(SweepPoint), MPI::BYTE,
+         MASTER);
+   for (p = 0; p < numPoints; p++)
+   {
+      points[p].firstNumber = p == 0 ? 0
+            : points[p - 1].firstNumber + points[p - 1].nsims;
+      if (slotBytes(points[p].nx, points[p].ny) > largest)
+      {
+         largest = slotBytes(points[p].nx, points[p].ny);
+         biggest = p;
+      }
+   }
+
+   // The pool is sized for the largest grid in the sweep, and "-engine
+   // auto" picks the engine for that grid, where the time goes.
+   arenaCreate(&gridArena, poolSlots(options) * largest);
+   poolCreate(&gridPool, &gridArena, largest, poolSlots(options));
+   grid = poolAcquire(&gridPool);
+   if (strcmp(options->engineName, "auto") == 0)
+      kernel = tuneKernel(options, points[biggest].nx, points[biggest].ny,
+            points[biggest].prob, myId);
+   hooks.series = NULL;
+   if (options->seriesPath != NULL)
+   {
+      seriesCreate(&series, options->seriesPath, myId);
+      hooks.series = &series;
+   }
+   hooks.snapshots = NULL;
+   if (options->snapshots.prefix != NULL)
+      hooks.snapshots = &options->snapshots;
+   hooks.trace = NULL;
+   z = normalQuantile(options->confidence / 100);
+   startTime = MPI::Wtime();
+
+   if (myId == MASTER && numProcs > 1 && !threaded)
+      sweepSchedule(points, numPoints, 1, numProcs, options, z, false);
+   else
+   {
+      if (myId == MASTER && threaded)
+         scheduler = std::thread(sweepSchedule, points, numPoints, 0,
+               numProcs, options, z, true);
+      results[2] = 0;
+      for (;;)
+      {
+         SweepPoint *point; /* point of the chunk */
+
+         // Hand in the last results and get the next chunk.
+         if (numProcs > 1)
+         {
+            MPI::COMM_WORLD.Send(results, 3 + 2 * results[2], MPI::INTEGER,
+                  MASTER, RESULTS_TAG);
+            MPI::COMM_WORLD.Recv(chunk, 3, MPI::INTEGER, MASTER, CHUNK_TAG);
+            if (chunk[2] == 0)
+               break;
+         }
+         else
+         {
+            if (results[2] > 0)
+               sweepRecord(&points[results[0]], results + 3, results[2],
+                     options->precision, z);
+            if (!sweepNextChunk(points, numPoints, 1, chunk))
+               break;
+         }
+         point = &points[chunk[0]];
+
+         // Masks depend on the grid size, so load them again when it
+         // changes.
+         if (point->nx != loadedNx || point->ny != loadedNy)
+         {
+            loadedNx = point->nx;
+            loadedNy = point->ny;
+            delete[] landscape;
+            landscape = NULL;
+            if (options->landscapePath != NULL)
+            {
+               landscape = new uint8_t[(size_t) loadedNx * loadedNy];
+               rasterLoad(options->landscapePath, loadedNx, loadedNy, 0,
+                     loadedNx, landscape);
+            }
+            probabilityMapDestroy(&options->probMap);
+            probabilityMapLoad(&options->probMap, loadedNx, loadedNy);
+         }
+
+         // Simulation numbers within a point give the seeds, so a point
+         // gets the same grids in a sweep as when it is run on its own.
+         results[0] = chunk[0];
+         results[1] = chunk[1];
+         results[2] = chunk[2];
+         for (k = 0; k < chunk[2]; k++)
+         {
+            int number = chunk[1] + k + 1; /* simulation number in the point */
+            int vegies; /* amount of stable vegetation */
+            int nsteps; /* number of steps actually run */
+
+            nsteps = runSimulation(kernel, grid, point->nx, point->ny,
+                  point->prob, simulationSeed(seed0, number),
+                  point->firstNumber + number,
+                  landscape, options, &hooks, &vegies);
+            results[3 + (k * 2) + NVEGIES_INDEX] = vegies;
+            results[3 + (k * 2) + NSTEPS_INDEX] = nsteps;
+         }
+      }
+      if (scheduler.joinable())
+         scheduler.join();
+   }
+
+   logFlush(&rankLog);
+   delete[] landscape;
+   probabilityMapDestroy(&options->probMap);
+   if (hooks.series != NULL)
+      seriesDestroy(hooks.series);
+   poolRelease(&gridPool, grid);
+   arenaDestroy(&gridArena);
+
+   if (myId == MASTER && options->verbosity >= VERBOSE_SUMMARY)
+   {
+      printf("\nSweep of %d points finished in %g seconds\n", numPoints,
+            MPI::Wtime() - startTime);
+      for (p = 0; p < numPoints; p++)
+      {
+         printf("\nPoint %d: %d x %d, probability %g, %d of %d simulations\n",
+               p + 1, points[p].nx, points[p].ny, points[p].prob,
+               points[p].finished, points[p].nsims);
+         if (points[p].finished > 0)
+            printSummary(&points[p].tally, &points[p].stats,
+                  points[p].finished, options->details);
+      }
+   }
+   delete[] points;
+} // runSweep
+
+
+/**
+  * Picks the grid of a verification case. The first cases are the edge
+  * sizes: single rows and columns, and sizes just off the vector widths.
+  * The rest have random sizes up to VERIFY_SIZE_MAX. Every case has its
+  * own seed and probability.
+  *
+  * @param c
+  *           is the number of the case
+  * @param nx
+  *           is where the x dimension is stored
+  * @param ny
+  *           is where the y dimension is stored
+  * @param seed
+  *           is where the seed is stored
+  * @param prob
+  *           is where the population probability is stored
+  */
+void verifyCase(int c, int *nx, int *ny, int *seed, double *prob)
+{
+   const int EDGES[][2] =
+   {
+      { 1, 1 }, { 1, 2 }, { 2, 1 }, { 1, 17 }, { 17, 1 }, { 1, 64 },
+      { 64, 1 }, { 3, 3 }, { 7, 9 }, { 8, 8 }, { 9, 7 }, { 15, 16 },
+      { 16, 17 }, { 31, 33 }, { 32, 32 }, { 63, 65 }, { 96, 96 }
+   };
+   const int NUM_EDGES = sizeof(EDGES) / sizeof(EDGES[0]);
+   double rand1(int);
+
+   if (c < NUM_EDGES)
+   {
+      *nx = EDGES[c][0];
+      *ny = EDGES[c][1];
+   }
+   else
+   {
+      *nx = 1 + (int) (rand1(4 * c + 1) * VERIFY_SIZE_MAX);
+      *ny = 1 + (int) (rand1(4 * c + 2) * VERIFY_SIZE_MAX);
+      *nx = *nx > VERIFY_SIZE_MAX ? VERIFY_SIZE_MAX : *nx;
+      *ny = *ny > VERIFY_SIZE_MAX ? VERIFY_SIZE_MAX : *ny;
+   }
+   *seed = (int) (rand1(4 * c + 3) * 2147483646.0);
+   *prob = 0.05 + 0.6 * rand1(4 * c + 4);
+} // verifyCase
+
+
+/**
+  * Checks every engine of every rule against the reference kernel, the
+  * "compute" engine, which applies the rule cell by cell. Each engine runs
+  * the same grids as the reference, and must match its digest at every
+  * step, its final grid and its steps and vegetation. Cases are dealt out
+  * over the ranks, and each mismatch is printed by the rank that finds it.
+  * Engines this CPU does not support are skipped.
+  *
+  * @param numCases
+  *           is the number of grids to check
+  * @param myId
+  *           is the rank of this process
+  * @param numProcs
+  *           is the number of processes
+  * @return the number of engine runs that failed, on every rank
+  */
+int runVerify(int numCases, int myId, int numProcs)
+{
+   const int MASTER = 0;
+
+   int *expected; /* grid run by the reference */
+   int *actual; /* grid run by the engine */
+   GridTrace expectedTrace; /* digests of the reference's steps */
+   GridTrace actualTrace; /* digests of the engine's steps */
+   StepHooks hooks; /* observers that only trace */
+   ProbabilityMap uniform; /* the same probability for every cell */
+   int counts[2] = { 0, 0 }; /* engine runs checked and failed */
+   int totals[2]; /* counts over every rank */
+   int nx, ny, seed; /* grid of the case */
+   double prob; /* population probability of the case */
+   int c, r, e, i; /* loop counters */
+
+   size_t slotBytes(int, int);
+   void arenaCreate(GridArena*, size_t);
+   void arenaDestroy(GridArena*);
+   void poolCreate(GridPool*, GridArena*, size_t, int);
+   int *poolAcquire(GridPool*);
+   void poolRelease(GridPool*, int*);
+   void probabilityMapSize(ProbabilityMap*, int, int);
+   void initializeGrid(int*, int, int, int, double, const uint8_t*,
+         const ProbabilityMap*);
+   LifeKernel findKernel(const char*, const char*);
+
+   // The two grids compared, and the next grid of the kernel being run.
+   arenaCreate(&gridArena, 3 * slotBytes(VERIFY_SIZE_MAX, VERIFY_SIZE_MAX));
+   poolCreate(&gridPool, &gridArena,
+         slotBytes(VERIFY_SIZE_MAX, VERIFY_SIZE_MAX), 3);
+   expected = poolAcquire(&gridPool);
+   actual = poolAcquire(&gridPool);
+   memset(&uniform, 0, sizeof(uniform));
+   uniform.kind = PROB_CONSTANT;
+   probabilityMapSize(&uniform, 1, 1);
+   hooks.series = NULL;
+   hooks.snapshots = NULL;
+
+   for (c = myId; c < numCases; c += numProcs)
+   {
+      verifyCase(c, &nx, &ny, &seed, &prob);
+      for (r = 0; r < NUM_RULES; r++)
+      {
+         LifeKernel reference = findKernel(RULES[r].name, "compute");
+         int expectedSteps, expectedVegies; /* results of the reference */
+
+         initializeGrid(expected, nx, ny, seed, prob, NULL, &uniform);
+         expectedTrace.count = 0;
+         hooks.trace = &expectedTrace;
+         expectedSteps = reference(expected, nx, ny, STEPS_MAX, UNCHANGED_MAX,
+               &expectedVegies, &hooks);
+
+         for (e = 0; e < NUM_ENGINES; e++)
+         {
+            LifeKernel kernel = findKernel(RULES[r].name, ENGINES[e].name);
+            const char *problem = NULL; /* first difference found */
+            char diverged[64]; /* the step the grids first differ at */
+            int steps, vegies; /* results of the engine */
+
+            if (kernel == NULL || kernel == reference)
+               continue;
+            initializeGrid(actual, nx, ny, seed, prob, NULL, &uniform);
+            actualTrace.count = 0;
+            hooks.trace = &actualTrace;
+            steps = kernel(actual, nx, ny, STEPS_MAX, UNCHANGED_MAX, &vegies,
+                  &hooks);
+
+            // The earliest difference says the most about the bug, so the
+            // step the grids part at is reported before the results.
+            for (i = 0; i < actualTrace.count && i < expectedTrace.count
+                  && problem == NULL; i++)
+            {
+               if (actualTrace.digests[i] != expectedTrace.digests[i])
+               {
+                  snprintf(diverged, sizeof(diverged),
+                        "grids differ from step %d", i + 1);
+                  problem = diverged;
+               }
+            }
+            if (problem == NULL && steps != expectedSteps)
+               problem = "steps differ";
+            else if (problem == NULL && vegies != expectedVegies)
+               problem = "vegetation differs";
+            for (i = 1; i <= nx && problem == NULL; i++)
+            {
+               if (memcmp(ROW(actual, ny, i) + 1, ROW(expected, ny, i) + 1,
+                     ny * sizeof(int)) != 0)
+                  problem = "the final grid differs";
+            }
+
+            counts[0] = counts[0] + 1;
+            if (problem != NULL)
+            {
+               counts[1] = counts[1] + 1;
+               printf("FAIL %s/%s, case %d (%d x %d, seed %d, probability "
+                     "%g): %s\n", RULES[r].name, ENGINES[e].name, c, nx, ny,
+                     seed, prob, problem);
+            }
+         }
+      }
+   }
+
+   MPI::COMM_WORLD.Allreduce(counts, totals, 2, MPI::INTEGER, MPI::SUM);
+   if (myId == MASTER)
+      printf("Verified %d engine runs on %d grids against the reference: "
+            "%d failed\n", totals[0], numCases, totals[1]);
+
+   poolRelease(&gridPool, actual);
+   poolRelease(&gridPool, expected);
+   arenaDestroy(&gridArena);
+   return totals[1];
+} // runVerify
+
+
+/**
+  * Reads the command line options. Options that are not given keep their
+  * default values.
+  *
+  * @param argc
+  *           is the number of command line arguments
+  * @param argv
+  *           is the list of command line arguments
+  * @param options
+  *           is the structure to fill in
+  */
+void parseOptions(int argc, char *argv[], Options *options)
+{
+   int i; /* loop counter */
+
+   options->ruleName = "standard";
+   options->engineName = "compute";
+   options->tuneCache = "life-engines.cache";
+   options->pinPolicy = "none";
+   options->recordsPath = NULL;
+   options->seriesPath = NULL;
+   options->snapshots.prefix = NULL;
+   options->snapshots.every = 0;
+   options->snapshots.final = false;
+   options->snapshots.encoding = SNAPSHOT_RAW;
+   options->snapshots.simulation = 0;
+   options->initPath = NULL;
+   options->landscapePath = NULL;
+   options->sweepPath = NULL;
+   options->verifyCases = 0;
+   options->probMap.kind = PROB_CONSTANT;
+   options->probMap.from = 1;
+   options->probMap.to = 1;
+   options->probMap.path = NULL;
+   options->probMap.tiles = NULL;
+   options->probMap.tileOfColumn = NULL;
+   options->verbosity = VERBOSE_SIM;
+   options->details = false;
+   options->coordinatorThread = true;
+   options->aggregate = "node";
+   options->precision = 0;
+   options->confidence = 95;
+   options->checkEvery = CHECK_EVERY;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-rule") == 0 && i + 1 < argc)
+         options->ruleName = argv[++i];
+      else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc)
+         options->engineName = argv[++i];
+      else if (strcmp(argv[i], "-tune-cache") == 0 && i + 1 < argc)
+         options->tuneCache = argv[++i];
+      else if (strcmp(argv[i], "-pin") == 0 && i + 1 < argc)
+         options->pinPolicy = argv[++i];
+      else if (strcmp(argv[i], "-records") == 0 && i + 1 < argc)
+         options->recordsPath = argv[++i];
+      else if (strcmp(argv[i], "-series") == 0 && i + 1 < argc)
+         options->seriesPath = argv[++i];
+      else if (strcmp(argv[i], "-snapshot") == 0 && i + 1 < argc)
+         options->snapshots.prefix = argv[++i];
+      else if (strcmp(argv[i], "-snapshot-every") == 0 && i + 1 < argc)
+         options->snapshots.every = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-snapshot-final") == 0)
+         options->snapshots.final = true;
+      else if (strcmp(argv[i], "-snapshot-compress") == 0 && i + 1 < argc)
+      {
+         i = i + 1;
+         if (strcmp(argv[i], "rle") == 0)
+            options->snapshots.encoding = SNAPSHOT_RLE;
+         else if (strcmp(argv[i], "zstd") == 0)
+         {
+# ifdef USE_ZSTD
+            options->snapshots.encoding = SNAPSHOT_ZSTD;
+# else
+            options->snapshots.encoding = SNAPSHOT_RLE;
+            if (MPI::COMM_WORLD.Get_rank() == 0)
+               fprintf(stderr, "Built without zstd, so snapshots use rle.\n");
+# endif
+         }
+         else
+            options->snapshots.encoding = SNAPSHOT_RAW;
+      }
+      else if (strcmp(argv[i], "-init") == 0 && i + 1 < argc)
+         options->initPath = argv[++i];
+      else if (strcmp(argv[i], "-landscape") == 0 && i + 1 < argc)
+         options->landscapePath = argv[++i];
+      else if (strcmp(argv[i], "-sweep") == 0 && i + 1 < argc)
+         options->sweepPath = argv[++i];
+      else if (strcmp(argv[i], "-prob-gradient") == 0 && i + 2 < argc)
+      {
+         options->probMap.kind = PROB_GRADIENT;
+         options->probMap.from = atof(argv[++i]);
+         options->probMap.to = atof(argv[++i]);
+      }
+      else if (strcmp(argv[i], "-prob-map") == 0 && i + 1 < argc)
+      {
+         options->probMap.kind = PROB_FILE;
+         options->probMap.path = argv[++i];
+      }
+      else if (strcmp(argv[i], "-coordinator") == 0 && i + 1 < argc)
+         options->coordinatorThread = strcmp(argv[++i], "inline") != 0;
+      else if (strcmp(argv[i], "-aggregate") == 0 && i + 1 < argc)
+         options->aggregate = argv[++i];
+      else if (strcmp(argv[i], "-precision") == 0 && i + 1 < argc)
+         options->precision = atof(argv[++i]);
+      else if (strcmp(argv[i], "-confidence") == 0 && i + 1 < argc)
+         options->confidence = atof(argv[++i]);
+      else if (strcmp(argv[i], "-verify") == 0 && i + 1 < argc)
+         options->verifyCases = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-check-every") == 0 && i + 1 < argc)
+      {
+         options->checkEvery = atoi(argv[++i]);
+         if (options->checkEvery < 1)
+            options->checkEvery = 1;
+      }
+      else if (strcmp(argv[i], "-verbose") == 0 && i + 1 < argc)
+      {
+         // Only the default output matches the original program's line for
+         // line, so the extra lines are kept for an explicit level.
+         i = i + 1;
+         options->details = true;
+         if (strcmp(argv[i], "none") == 0)
+            options->verbosity = VERBOSE_NONE;
+         else if (strcmp(argv[i], "summary") == 0)
+            options->verbosity = VERBOSE_SUMMARY;
+         else
+            options->verbosity = VERBOSE_SIM;
+      }
+   }
+} // parseOptions
+
+
+/**
+  * Finds the simulation kernel compiled for the named growth rule and engine.
+  *
+  * @param ruleName
+  *           is the name of the rule, as listed in RULES
+  * @param engineName
+  *           is the name of the engine, as listed in ENGINES
+  * @return the kernel, or NULL if there is no such rule or engine, or the
+  *         engine is not supported by this CPU
+  */
+LifeKernel findKernel(const char *ruleName, const char *engineName)
+{
+   bool cpuHas(const char*);
+   int i; /* loop counter */
+
+   for (i = 0; i < NUM_ENGINES; i++)
+   {
+      if (strcmp(ENGINES[i].name, engineName) == 0)
+         break;
+   }
+   if (i == NUM_ENGINES
+         || (ENGINES[i].feature != NULL && !cpuHas(ENGINES[i].feature)))
+      return NULL;
+
+   for (i = 0; i < NUM_RULES; i++)
+   {
+      if (strcmp(RULES[i].name, ruleName) == 0)
+         return RULES[i].kernel(engineName);
+   }
+   return NULL;
+} // findKernel
+
+
+/**
+  * Tells whether the CPU running this process has a feature.
+  *
+  * @param feature
+  *           is the name of the feature, as listed in CPU_FEATURES
+  * @return true if the CPU has it
+  */
+bool cpuHas(const char *feature)
+{
+# ifdef HAVE_X86_SIMD
+   if (strcmp(feature, "sse4.2") == 0)
+      return __builtin_cpu_supports("sse4.2");
+   if (strcmp(feature, "avx2") == 0)
+      return __builtin_cpu_supports("avx2");
+   if (strcmp(feature, "avx512f") == 0)
+      return __builtin_cpu_supports("avx512f");
+   if (strcmp(feature, "avx512bw") == 0)
+      return __builtin_cpu_supports("avx512bw");
+# endif
+   return false;
+} // cpuHas
+
+
+/**
+  * Reads the model name of the CPU from /proc/cpuinfo. Nodes of different
+  * CPU generations have different names, so the name keys the tuning
+  * cache.
+  *
+  * @param model
+  *           is where the name is stored
+  * @param size
+  *           is the size of model
+  */
+void cpuModel(char *model, size_t size)
+{
+   FILE *file; /* /proc/cpuinfo */
+   char line[256]; /* line being read */
+   char *value; /* the part of the line after the colon */
+
+   snprintf(model, size, "unknown");
+   file = fopen("/proc/cpuinfo", "r");
+   if (file == NULL)
+      return;
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      value = strchr(line, ':');
+      if (strncmp(line, "model name", 10) == 0 && value != NULL)
+      {
+         value = value + 1 + strspn(value + 1, " \t");
+         value[strcspn(value, "\n")] = 0;
+         snprintf(model, size, "%s", value);
+         break;
+      }
+   }
+   fclose(file);
+} // cpuModel
+
+
+/**
+  * Times one engine on grids like those of the job. Every run starts from
+  * the same grid and runs at most TUNE_STEPS steps, and the fastest of
+  * TUNE_RUNS runs counts, so that one slow run does not decide the choice.
+  *
+  * @param kernel
+  *           is the engine's kernel
+  * @param grid
+  *           is a grid from the pool
+  * @param nx
+  *           is the x dimension of the grids
+  * @param ny
+  *           is the y dimension of the grids
+  * @param prob
+  *           is the population probability
+  * @return the seconds of the fastest run
+  */
+double tuneTime(LifeKernel kernel, int *grid, int nx, int ny, double prob)
+{
+   ProbabilityMap uniform; /* the same probability for every cell */
+   double best = -1; /* fastest run so far */
+   double time; /* time of a run */
+   int vegies; /* amount of vegetation */
+   int run; /* loop counter */
+   void probabilityMapSize(ProbabilityMap*, int, int);
+   void initializeGrid(int*, int, int, int, double, const uint8_t*,
+         const ProbabilityMap*);
+
+   memset(&uniform, 0, sizeof(uniform));
+   uniform.kind = PROB_CONSTANT;
+   probabilityMapSize(&uniform, nx, ny);
+   for (run = 0; run < TUNE_RUNS; run++)
+   {
+      initializeGrid(grid, nx, ny, TUNE_SEED, prob, NULL, &uniform);
+      time = MPI::Wtime();
+      kernel(grid, nx, ny, TUNE_STEPS, TUNE_STEPS, &vegies, NULL);
+      time = MPI::Wtime() - time;
+      if (best < 0 || time < best)
+         best = time;
+   }
+   return best;
+} // tuneTime
+
+
+/**
+  * Picks the fastest engine for a rule on grids of the given size, on this
+  * node. Every rank must call this, with the grid pool set up. Rank 0 of
+  * each node looks the choice up in the tuning cache, or times every
+  * engine the node's CPU supports and adds the fastest to the cache, and
+  * tells the node's other ranks. They wait for it asleep rather than
+  * spinning on the cores it is timing on. Nodes of a mixed cluster each
+  * make their own choice.
+  *
+  * The cache is a text file with a line "<rule> <nx> <ny> <engine> <CPU
+  * model>" for every choice made. The last line that matches wins.
+  *
+  * @param options
+  *           is the command line options
+  * @param nx
+  *           is the x dimension of the grids
+  * @param ny
+  *           is the y dimension of the grids
+  * @param prob
+  *           is the population probability
+  * @param myId
+  *           is the rank of this process
+  * @return the kernel of the chosen engine
+  */
+LifeKernel tuneKernel(const Options *options, int nx, int ny, double prob,
+      int myId)
+{
+   const int MASTER = 0;
+
+   MPI_Comm node; /* ranks sharing this node */
+   MPI_Request request; /* broadcast of the choice */
+   int nodeRank; /* rank within the node */
+   int choice = -1; /* index in ENGINES of the chosen engine */
+   int done = 0; /* whether the broadcast has finished */
+   bool cached = false; /* whether the choice came from the cache */
+   char model[128]; /* model name of this node's CPU */
+   int e; /* loop counter */
+   int *grid; /* grid to time the engines on */
+   int *poolAcquire(GridPool*);
+   void poolRelease(GridPool*, int*);
+
+   MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, myId,
+         MPI_INFO_NULL, &node);
+   MPI_Comm_rank(node, &nodeRank);
+   cpuModel(model, sizeof(model));
+
+   if (nodeRank == 0)
+   {
+      FILE *file = fopen(options->tuneCache, "r"); /* the cache */
+      char line[512]; /* line of the cache */
+      char rule[64], engine[64], lineModel[256]; /* fields of the line */
+      int lineNx, lineNy; /* grid size of the line */
+      double best = -1; /* time of the fastest engine so far */
+
+      while (file != NULL && fgets(line, sizeof(line), file) != NULL)
+      {
+         if (sscanf(line, "%63s %d %d %63s %255[^\n]", rule, &lineNx, &lineNy,
+               engine, lineModel) < 5 || strcmp(rule, options->ruleName) != 0
+               || lineNx != nx || lineNy != ny || strcmp(lineModel, model) != 0)
+            continue;
+         for (e = 0; e < NUM_ENGINES; e++)
+         {
+            if (strcmp(ENGINES[e].name, engine) == 0
+                  && findKernel(options->ruleName, engine) != NULL)
+               choice = e;
+         }
+      }
+      if (file != NULL)
+         fclose(file);
+      cached = choice >= 0;
+
+      if (!cached)
+      {
+         grid = poolAcquire(&gridPool);
+         for (e = 0; e < NUM_ENGINES; e++)
+         {
+            LifeKernel kernel = findKernel(options->ruleName, ENGINES[e].name);
+            double time; /* time of the engine */
+
+            if (kernel == NULL)
+               continue;
+            time = tuneTime(kernel, grid, nx, ny, prob);
+            if (best < 0 || time < best)
+            {
+               best = time;
+               choice = e;
+            }
+         }
+         poolRelease(&gridPool, grid);
+
+         file = fopen(options->tuneCache, "a");
+         if (file != NULL)
+         {
+            fprintf(file, "%s %d %d %s %s\n", options->ruleName, nx, ny,
+                  ENGINES[choice].name, model);
+            fclose(file);
+         }
+      }
+   }
+
+   MPI_Ibcast(&choice, 1, MPI_INT, 0, node, &request);
+   for (MPI_Test(&request, &done, MPI_STATUS_IGNORE); !done;
+         MPI_Test(&request, &done, MPI_STATUS_IGNORE))
+      usleep(COORDINATOR_POLL_US);
+   MPI_Comm_free(&node);
+
+   if (myId == MASTER && options->verbosity >= VERBOSE_SUMMARY)
+      printf("Engine for %d x %d grids on this %s: %s (%s)\n", nx, ny, model,
+            ENGINES[choice].name, cached ? "cached" : "tuned");
+   return findKernel(options->ruleName, ENGINES[choice].name);
+} // tuneKernel
+
+
+/**
+  * Decides the outcome of a simulation from its results.
+  *
+  * @param vegies
+  *           is the final amount of vegetation
+  * @param nsteps
+  *           is the number of steps the simulation ran
+  * @param maxSteps
+  *           is the max # of timesteps the simulation was allowed
+  * @return OUTCOME_DIED, OUTCOME_UNSETTLED or OUTCOME_STABLE
+  */
+int classifySimulation(int vegies, int nsteps, int maxSteps)
+{
+   if (vegies == 0)
+      return OUTCOME_DIED;
+   if (nsteps >= maxSteps)
+      return OUTCOME_UNSETTLED;
+   return OUTCOME_STABLE;
+} // classifySimulation
+
+
+/**
+  * Adds results to the master's outcome counts.
+  *
+  * @param tally
+  *           is the outcome counts
+  * @param results
+  *           is count pairs of vegetation and step results
+  * @param count
+  *           is the number of simulations in results
+  * @param maxSteps
+  *           is the max # of timesteps the simulations were allowed
+  */
+void tallyResults(CampaignTally *tally, const int *results, int count,
+      int maxSteps)
+{
+   int i; /* loop counter */
+
+   for (i = 0; i < count; i++)
+   {
+      switch (classifySimulation(results[(i * 2) + NVEGIES_INDEX],
+            results[(i * 2) + NSTEPS_INDEX], maxSteps))
+      {
+      case OUTCOME_DIED:
+         tally->ndied = tally->ndied + 1;
+         break;
+      case OUTCOME_UNSETTLED:
+         tally->nunsettled = tally->nunsettled + 1;
+         break;
+      default:
+         tally->nstable = tally->nstable + 1;
+         break;
+      }
+   } // for
+} // tallyResults
+
+
+/**
+  * Empties a streaming summary.
+  *
+  * @param stream
+  *           is the summary
+  */
+void streamClear(StreamStats *stream)
+{
+   memset(stream, 0, sizeof(*stream));
+} // streamClear
+
+
+/**
+  * Adds to a sum kept in two 64-bit words.
+  *
+  * @param sum
+  *           is the sum, low word first
+  * @param low
+  *           is the low word of the value to add
+  * @param high
+  *           is the high word of the value to add
+  */
+void wideAdd(uint64_t sum[2], uint64_t low, uint64_t high)
+{
+   sum[0] = sum[0] + low;
+   sum[1] = sum[1] + high + (sum[0] < low);
+} // wideAdd
+
+
+/**
+  * Adds a value to a streaming summary.
+  *
+  * @param stream
+  *           is the summary
+  * @param value
+  *           is the value, which must not be negative
+  */
+void streamAdd(StreamStats *stream, int value)
+{
+   int b; /* bucket of the value */
+
+   if (stream->count == 0 || value < stream->min)
+      stream->min = value;
+   if (stream->count == 0 || value > stream->max)
+      stream->max = value;
+   stream->count = stream->count + 1;
+   stream->sum = stream->sum + value;
+   wideAdd(stream->squares, (uint64_t) value * value, 0);
+
+   if (value <= 0)
+      stream->zeros = stream->zeros + 1;
+   else
+   {
+      b = (int) ceil(log(value) / log(SKETCH_GAMMA));
+      b = b < 0 ? 0 : b >= SKETCH_BUCKETS ? SKETCH_BUCKETS - 1 : b;
+      stream->buckets[b] = stream->buckets[b] + 1;
+   }
+} // streamAdd
+
+
+/**
+  * Merges one streaming summary into another, as if every value added to
+  * the first had been added to the second.
+  *
+  * @param from
+  *           is the summary to merge
+  * @param into
+  *           is the summary that receives it
+  */
+void streamMerge(const StreamStats *from, StreamStats *into)
+{
+   int b; /* loop counter */
+
+   if (from->count == 0)
+      return;
+   if (into->count == 0)
+   {
+      *into = *from;
+      return;
+   }
+
+   into->count = into->count + from->count;
+   into->sum = into->sum + from->sum;
+   wideAdd(into->squares, from->squares[0], from->squares[1]);
+   into->min = from->min < into->min ? from->min : into->min;
+   into->max = from->max > into->max ? from->max : into->max;
+   into->zeros = into->zeros + from->zeros;
+   for (b = 0; b < SKETCH_BUCKETS; b++)
+      into->buckets[b] = into->buckets[b] + from->buckets[b];
+} // streamMerge
+
+
+/**
+  * Computes the mean of a streaming summary.
+  *
+  * @param stream
+  *           is the summary
+  * @return the mean, or 0 if the summary is empty
+  */
+double streamMean(const StreamStats *stream)
+{
+   if (stream->count == 0)
+      return 0;
+   return (double) stream->sum / stream->count;
+} // streamMean
+
+
+/**
+  * Computes the sample standard deviation of a streaming summary.
+  *
+  * @param stream
+  *           is the summary
+  * @return the standard deviation, or 0 for fewer than two values
+  */
+double streamStdDev(const StreamStats *stream)
+{
+   long double squares; /* sum of the squares */
+   long double m2; /* sum of squared deviations from the mean */
+
+   if (stream->count < 2)
+      return 0;
+   squares = ldexpl((long double) stream->squares[1], 64)
+         + stream->squares[0];
+   m2 = squares - (long double) stream->sum * stream->sum / stream->count;
+   return m2 > 0 ? sqrt((double) (m2 / (stream->count - 1))) : 0;
+} // streamStdDev
+
+
+/**
+  * Estimates a quantile of a streaming summary from its sketch. The estimate
+  * is the middle of the bucket holding the quantile, which is within 1% of
+  * the true value.
+  *
+  * @param stream
+  *           is the summary
+  * @param q
+  *           is the quantile, between 0 and 1
+  * @return the estimate, or 0 if the summary is empty
+  */
+double streamQuantile(const StreamStats *stream, double q)
+{
+   int64_t rank; /* number of values below the quantile */
+   int64_t seen; /* number of values in the buckets so far */
+   double value; /* estimate */
+   int b; /* loop counter */
+
+   if (stream->count == 0)
+      return 0;
+   rank = (int64_t) (q * (stream->count - 1));
+   seen = stream->zeros;
+   if (rank < seen)
+      return 0;
+   for (b = 0; b < SKETCH_BUCKETS - 1; b++)
+   {
+      seen = seen + stream->buckets[b];
+      if (rank < seen)
+         break;
+   }
+   value = 2 * pow(SKETCH_GAMMA, b) / (SKETCH_GAMMA + 1);
+   value = value < stream->min ? stream->min : value;
+   return value > stream->max ? stream->max : value;
+} // streamQuantile
+
+
+/**
+  * Empties a rank's distributions.
+  *
+  * @param stats
+  *           is the distributions
+  */
+void statsClear(SimulationStats *stats)
+{
+   streamClear(&stats->steps);
+   streamClear(&stats->stableSteps);
+   streamClear(&stats->stableVegetation);
+} // statsClear
+
+
+/**
+  * Adds the results of a simulation to a rank's distributions.
+  *
+  * @param stats
+  *           is the distributions
+  * @param vegies
+  *           is the final amount of vegetation
+  * @param nsteps
+  *           is the number of steps the simulation ran
+  * @param maxSteps
+  *           is the max # of timesteps the simulation was allowed
+  */
+void statsAdd(SimulationStats *stats, int vegies, int nsteps, int maxSteps)
+{
+   streamAdd(&stats->steps, nsteps);
+   if (classifySimulation(vegies, nsteps, maxSteps) == OUTCOME_STABLE)
+   {
+      streamAdd(&stats->stableSteps, nsteps);
+      streamAdd(&stats->stableVegetation, vegies);
+   }
+} // statsAdd
+
+
+/**
+  * Reduction operator that merges SimulationStats, for MPI::Op::Init. The
+  * operator is only used with the SimulationStats datatype, so the datatype
+  * argument is not needed.
+  *
+  * @param in
+  *           is the distributions to merge
+  * @param inout
+  *           is the distributions that receive them
+  * @param len
+  *           is the number of SimulationStats in each
+  */
+void statsMerge(const void *in, void *inout, int len, const MPI::Datatype&)
+{
+   const SimulationStats *from = (const SimulationStats*) in;
+   SimulationStats *into = (SimulationStats*) inout;
+   int i; /* loop counter */
+
+   for (i = 0; i < len; i++)
+   {
+      streamMerge(&from[i].steps, &into[i].steps);
+      streamMerge(&from[i].stableSteps, &into[i].stableSteps);
+      streamMerge(&from[i].stableVegetation, &into[i].stableVegetation);
+   }
+} // statsMerge
+
+
+/**
+  * Finds z such that a standard normal variable lies in [-z, z] with the
+  * given probability, by bisection on erf.
+  *
+  * @param level
+  *           is the probability, between 0 and 1
+  * @return z
+  */
+double normalQuantile(double level)
+{
+   double low = 0, high = 10; /* bracket of z */
+   int i; /* loop counter */
+
+   for (i = 0; i < 60; i++)
+   {
+      double mid = (low + high) / 2;
+
+      if (erf(mid / sqrt(2.0)) < level)
+         low = mid;
+      else
+         high = mid;
+   }
+   return (low + high) / 2;
+} // normalQuantile
+
+
+/**
+  * Decides whether the outcome percentages are known precisely enough to
+  * stop the campaign. Each percentage gets a Wilson score interval, which
+  * stays honest when an outcome has not been seen yet or is seen every
+  * time, where the plain normal interval would have zero width.
+  *
+  * @param tally
+  *           is the outcome counts so far
+  * @param precision
+  *           is the wanted half width of every interval, in percent, or 0
+  *           to never stop early
+  * @param z
+  *           is the normal quantile of the confidence level
+  * @return true if every interval is at most precision wide on each side
+  */
+bool campaignPrecise(const CampaignTally *tally, double precision, double z)
+{
+   int counts[3] = { tally->ndied, tally->nunsettled, tally->nstable };
+   double n = counts[0] + counts[1] + counts[2]; /* simulations so far */
+   int k; /* outcome */
+
+   if (precision <= 0 || n == 0)
+      return false;
+   for (k = 0; k < 3; k++)
+   {
+      double p = counts[k] / n;
+      double halfWidth = z * sqrt(p * (1 - p) / n + z * z / (4 * n * n))
+            / (1 + z * z / n);
+
+      if (100 * halfWidth > precision)
+         return false;
+   }
+   return true;
+} // campaignPrecise
+
+
+/**
+  * Adds one set of outcome counts to another.
+  *
+  * @param into
+  *           is the counts to add to
+  * @param from
+  *           is the counts to add
+  */
+void tallyAdd(CampaignTally *into, const CampaignTally *from)
+{
+   into->ndied = into->ndied + from->ndied;
+   into->nunsettled = into->nunsettled + from->nunsettled;
+   into->nstable = into->nstable + from->nstable;
+} // tallyAdd
+
+
+/**
+  * Posts a coordinator's receives for the blocks of ranks firstRank and up
+  * of a communicator.
+  *
+  * @param inbox
+  *           is the inbox
+  * @param firstRank
+  *           is the rank of the first sender
+  * @param comm
+  *           is the communicator the blocks travel on
+  */
+void inboxCreate(ResultInbox *inbox, int firstRank, MPI::Intracomm &comm)
+{
+   int numSenders = comm.Get_size() - firstRank; /* number of senders */
+   int r; /* loop counter */
+
+   inbox->comm = comm;
+   inbox->firstRank = firstRank;
+   inbox->numRequests = 2 * numSenders;
+   inbox->active = numSenders;
+   inbox->blocks = new CampaignTally[inbox->numRequests + 1];
+   inbox->done = new bool[comm.Get_size()]();
+   inbox->requests = new MPI::Request[inbox->numRequests + 1];
+   inbox->statuses = new MPI::Status[inbox->numRequests + 1];
+   inbox->indices = new int[inbox->numRequests + 1];
+   for (r = 0; r < inbox->numRequests; r++)
+   {
+      inbox->requests[r] = comm.Irecv(&inbox->blocks[r], 3, MPI::INTEGER,
+            r / 2 + firstRank, MPI::ANY_TAG);
+   }
+} // inboxCreate
+
+
+/**
+  * Adds up the blocks that have arrived, and posts new receives in their
+  * place. A sender's last block is tagged RESULTS_TAG. Once it is in, the
+  * sender's other receive is cancelled.
+  *
+  * @param inbox
+  *           is the inbox
+  * @param tally
+  *           is the outcome counts to add the blocks to
+  * @return the number of blocks that arrived
+  */
+int inboxPoll(ResultInbox *inbox, CampaignTally *tally)
+{
+   int numDone; /* number of receives that completed */
+   int k; /* loop counter */
+
+   if (inbox->active == 0)
+      return 0;
+   numDone = MPI::Request::Testsome(inbox->numRequests, inbox->requests,
+         inbox->indices, inbox->statuses);
+
+   for (k = 0; k < numDone; k++)
+   {
+      int r = inbox->indices[k]; /* receive that completed */
+      int sender = r / 2 + inbox->firstRank; /* rank it was from */
+
+      tallyAdd(tally, &inbox->blocks[r]);
+      if (inbox->statuses[k].Get_tag() == RESULTS_TAG)
+      {
+         inbox->done[sender] = true;
+         inbox->active = inbox->active - 1;
+         if (inbox->requests[r ^ 1] != MPI::REQUEST_NULL)
+         {
+            inbox->requests[r ^ 1].Cancel();
+            inbox->requests[r ^ 1].Wait();
+         }
+      }
+      else if (!inbox->done[sender])
+      {
+         inbox->requests[r] = inbox->comm.Irecv(&inbox->blocks[r], 3,
+               MPI::INTEGER, sender, MPI::ANY_TAG);
+      }
+   }
+   return numDone;
+} // inboxPoll
+
+
+/**
+  * Frees what inboxCreate allocated. Every sender must have sent its last
+  * block.
+  *
+  * @param inbox
+  *           is the inbox
+  */
+void inboxDestroy(ResultInbox *inbox)
+{
+   delete[] inbox->blocks;
+   delete[] inbox->done;
+   delete[] inbox->requests;
+   delete[] inbox->statuses;
+   delete[] inbox->indices;
+} // inboxDestroy
+
+
+/**
+  * Sets up blocks to rank 0 of a communicator.
+  *
+  * @param outbox
+  *           is the outbox
+  * @param blockSize
+  *           is the number of simulations in a full block
+  * @param comm
+  *           is the communicator the blocks travel on
+  */
+void outboxCreate(ResultOutbox *outbox, int blockSize, MPI::Intracomm &comm)
+{
+   outbox->comm = comm;
+   outbox->blockSize = blockSize;
+   outbox->current = 0;
+   memset(outbox->blocks, 0, sizeof(outbox->blocks));
+   outbox->requests[0] = MPI::REQUEST_NULL;
+   outbox->requests[1] = MPI::REQUEST_NULL;
+} // outboxCreate
+
+
+/**
+  * Adds outcome counts to the current block. A full block is sent, and the
+  * other block, once its own send is done, becomes the current one.
+  *
+  * @param outbox
+  *           is the outbox
+  * @param counts
+  *           is the counts to add
+  * @return true if a block was sent
+  */
+bool outboxAdd(ResultOutbox *outbox, const CampaignTally *counts)
+{
+   CampaignTally *block = &outbox->blocks[outbox->current];
+
+   tallyAdd(block, counts);
+   if (block->ndied + block->nunsettled + block->nstable < outbox->blockSize)
+      return false;
+
+   outbox->requests[outbox->current] = outbox->comm.Isend(block, 3,
+         MPI::INTEGER, 0, PROGRESS_TAG);
+   outbox->current = outbox->current ^ 1;
+   outbox->requests[outbox->current].Wait();
+   memset(&outbox->blocks[outbox->current], 0, sizeof(CampaignTally));
+   return true;
+} // outboxAdd
+
+
+/**
+  * Sends the current block, which may be empty, as the last one, and waits
+  * for every send to finish.
+  *
+  * @param outbox
+  *           is the outbox
+  */
+void outboxFinish(ResultOutbox *outbox)
+{
+   outbox->requests[outbox->current] = outbox->comm.Isend(
+         &outbox->blocks[outbox->current], 3, MPI::INTEGER, 0, RESULTS_TAG);
+   MPI::Request::Waitall(2, outbox->requests);
+} // outboxFinish
+
+
+/**
+  * Splits the ranks into groups for aggregation.
+  *
+  * @param tree
+  *           is the tree to set up
+  * @param aggregate
+  *           is "flat" for a single group, "node" for a group per node, or
+  *           a number of consecutive ranks per group
+  * @param myId
+  *           is the rank of this process
+  */
+void treeCreate(AggregationTree *tree, const char *aggregate, int myId)
+{
+   MPI_Comm node; /* ranks sharing this node */
+   int perGroup; /* ranks per group */
+
+   if (strcmp(aggregate, "flat") == 0)
+      tree->group = MPI::COMM_WORLD.Dup();
+   else if (strcmp(aggregate, "node") == 0)
+   {
+      MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, myId,
+            MPI_INFO_NULL, &node);
+      tree->group = MPI::Intracomm(node);
+   }
+   else
+   {
+      perGroup = atoi(aggregate);
+      perGroup = perGroup < 1 ? 1 : perGroup;
+      tree->group = MPI::COMM_WORLD.Split(myId / perGroup, myId);
+   }
+   tree->groupBlocks = tree->group.Dup();
+
+   tree->leaders = MPI::COMM_WORLD.Split(
+         tree->group.Get_rank() == 0 ? 0 : MPI::UNDEFINED, myId);
+   tree->numGroups = 0;
+   if (tree->leaders != MPI::COMM_NULL)
+   {
+      tree->leaderBlocks = tree->leaders.Dup();
+      tree->numGroups = tree->leaders.Get_size();
+   }
+} // treeCreate
+
+
+/**
+  * Frees the communicators of an aggregation tree.
+  *
+  * @param tree
+  *           is the tree
+  */
+void treeDestroy(AggregationTree *tree)
+{
+   if (tree->leaders != MPI::COMM_NULL)
+   {
+      tree->leaderBlocks.Free();
+      tree->leaders.Free();
+   }
+   tree->groupBlocks.Free();
+   tree->group.Free();
+} // treeDestroy
+
+
+/**
+  * Allocates the shared window of this rank's node. Every rank must call
+  * this. The node's rank 0 owns the memory and the others map it.
+  *
+  * @param node
+  *           is the node's shared memory to set up
+  * @param landscapeBytes
+  *           is the size of the landscape, or 0 for none
+  * @param tileBytes
+  *           is the size of the probability map raster, or 0 for none
+  * @param myId
+  *           is the rank of this process
+  */
+void nodeShareCreate(NodeShare *node, size_t landscapeBytes, size_t tileBytes,
+      int myId)
+{
+   MPI_Aint bytes; /* size of the shared segment */
+   MPI_Aint landscapeRoom; /* landscapeBytes rounded up to an alignment */
+   int unit; /* displacement unit of the segment */
+   char *base; /* start of the shared segment */
+
+   static_assert(std::atomic<uint64_t>::is_always_lock_free
+         && std::atomic<int>::is_always_lock_free,
+         "node batches need lock-free atomics");
+   MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, myId,
+         MPI_INFO_NULL, &node->comm);
+   MPI_Comm_rank(node->comm, &node->rank);
+   MPI_Comm_size(node->comm, &node->size);
+
+   landscapeRoom = (landscapeBytes + NODE_SHARE_ALIGN - 1)
+         / NODE_SHARE_ALIGN * NODE_SHARE_ALIGN;
+   bytes = NODE_SHARE_ALIGN + landscapeRoom + tileBytes;
+   MPI_Win_allocate_shared(node->rank == 0 ? bytes : 0, 1, MPI_INFO_NULL,
+         node->comm, &base, &node->win);
+   MPI_Win_shared_query(node->win, 0, &bytes, &unit, &base);
+   MPI_Win_lock_all(MPI_MODE_NOCHECK, node->win);
+
+   // The batch starts empty, so the first claim on the node fetches one.
+   node->batch = (std::atomic<uint64_t> *) base;
+   node->refill = (std::atomic<int> *) (base + sizeof(uint64_t));
+   if (node->rank == 0)
+   {
+      node->batch->store(0);
+      node->refill->store(NODE_BATCH_READY);
+   }
+   node->landscape = landscapeBytes > 0
+         ? (uint8_t *) base + NODE_SHARE_ALIGN : NULL;
+   node->tiles = tileBytes > 0
+         ? (uint8_t *) base + NODE_SHARE_ALIGN + landscapeRoom : NULL;
+} // nodeShareCreate
+
+
+/**
+  * Waits until the node's rank 0 has filled in the shared window, and
+  * makes what it wrote visible to this rank. Every rank must call this.
+  *
+  * @param node
+  *           is the node's shared memory
+  */
+void nodeShareReady(NodeShare *node)
+{
+   MPI_Win_sync(node->win);
+   MPI_Barrier(node->comm);
+   MPI_Win_sync(node->win);
+} // nodeShareReady
+
+
+/**
+  * Frees the shared window of this rank's node. Every rank must call this.
+  *
+  * @param node
+  *           is the node's shared memory
+  */
+void nodeShareDestroy(NodeShare *node)
+{
+   MPI_Win_unlock_all(node->win);
+   MPI_Win_free(&node->win);
+   MPI_Comm_free(&node->comm);
+} // nodeShareDestroy
+
+
+/**
+  * Sets up the counter simulations are claimed from. Every rank must call
+  * this. Every claim is of the same size, so to even out the end of the
+  * campaign a node's claim is kept to about a WORK_CHUNKS_PER_RANK-th of
+  * the share of each of its ranks.
+  *
+  * @param work
+  *           is the counter
+  * @param total
+  *           is the number of simulations to hand out
+  * @param numProcs
+  *           is the number of processes
+  * @param nodeSize
+  *           is the number of ranks on this rank's node
+  */
+void workCreate(WorkCounter *work, int total, int numProcs, int nodeSize)
+{
+   const int MASTER = 0;
+   int myId = MPI::COMM_WORLD.Get_rank(); /* rank of this process */
+
+   MPI_Win_allocate(myId == MASTER ? sizeof(int) : 0, sizeof(int),
+         MPI_INFO_NULL, MPI_COMM_WORLD, &work->next, &work->win);
+   // A fence would open an active target epoch that lock_all may not
+   // follow, so the store is published with a sync and a barrier instead.
+   MPI_Win_lock_all(MPI_MODE_NOCHECK, work->win);
+   if (myId == MASTER)
+   {
+      *work->next = 0;
+      MPI_Win_sync(work->win);
+   }
+   MPI_Barrier(MPI_COMM_WORLD);
+
+   work->total = total;
+   work->chunk = total / (numProcs * WORK_CHUNKS_PER_RANK);
+   work->chunk = work->chunk < 1 ? 1
+         : work->chunk > WORK_CHUNK_MAX ? WORK_CHUNK_MAX : work->chunk;
+   work->chunk = work->chunk * nodeSize;
+} // workCreate
+
+
+/**
+  * Claims the next chunk of simulations for this rank's node.
+  *
+  * @param work
+  *           is the counter
+  * @param first
+  *           is where the index of the first simulation of the chunk is
+  *           stored
+  * @param count
+  *           is where the number of simulations in the chunk is stored
+  * @return false if there are no simulations left
+  */
+bool workClaim(WorkCounter *work, int *first, int *count)
+{
+   const int MASTER = 0;
+
+   MPI_Fetch_and_op(&work->chunk, first, MPI_INT, MASTER, 0, MPI_SUM,
+         work->win);
+   MPI_Win_flush(MASTER, work->win);
+   if (*first >= work->total)
+      return false;
+   *count = work->total - *first < work->chunk ? work->total - *first
+         : work->chunk;
+   return true;
+} // workClaim
+
+
+/**
+  * Claims the next simulation of the node's batch. Only when the batch
+  * runs out does a rank go to the master's counter, and it fetches a whole
+  * new batch for the node while the node's other ranks wait for it. The
+  * batch is refilled by whichever rank finds it empty rather than by a set
+  * leader, so a rank busy with a long simulation never holds up the others.
+  *
+  * @param node
+  *           is the node's shared memory
+  * @param work
+  *           is the counter batches are claimed from
+  * @param claim
+  *           is where the index of the claimed simulation is stored
+  * @return false if there are no simulations left
+  */
+bool nodeClaim(NodeShare *node, WorkCounter *work, int *claim)
+{
+   uint64_t batch; /* next and end of the node's batch */
+   int state; /* NODE_BATCH_READY, NODE_BATCH_REFILLING or NODE_BATCH_DONE */
+   int first, count; /* a new batch */
+   bool workClaim(WorkCounter*, int*, int*);
+
+   for (;;)
+   {
+      batch = node->batch->load();
+      if ((uint32_t) (batch >> 32) < (uint32_t) batch)
+      {
+         if (node->batch->compare_exchange_weak(batch,
+               batch + ((uint64_t) 1 << 32)))
+         {
+            *claim = (int) (batch >> 32);
+            return true;
+         }
+         continue;
+      }
+
+      // The batch is empty. One rank refills it, and the batch is looked
+      // at again once it holds the refill, since another rank may have
+      // refilled it in the meantime.
+      state = NODE_BATCH_READY;
+      if (node->refill->compare_exchange_strong(state, NODE_BATCH_REFILLING))
+      {
+         batch = node->batch->load();
+         if ((uint32_t) (batch >> 32) >= (uint32_t) batch)
+         {
+            if (!workClaim(work, &first, &count))
+            {
+               node->refill->store(NODE_BATCH_DONE);
+               return false;
+            }
+            node->batch->store(((uint64_t) first << 32)
+                  | (uint32_t) (first + count));
+         }
+         node->refill->store(NODE_BATCH_READY);
+      }
+      else if (state == NODE_BATCH_DONE)
+         return false;
+      else
+         std::this_thread::yield();
+   }
+} // nodeClaim
+
+
+/**
+  * Frees the counter simulations are claimed from. Every rank must call
+  * this.
+  *
+  * @param work
+  *           is the counter
+  */
+void workDestroy(WorkCounter *work)
+{
+   MPI_Win_unlock_all(work->win);
+   MPI_Win_free(&work->win);
+} // workDestroy
+
+
+/**
+  * Sets up a coordinator at the top of the tree and posts its receives.
+  *
+  * @param coordinator
+  *           is the coordinator
+  * @param firstRank
+  *           is the first rank that sends blocks: 0 if the coordinator's
+  *           own rank sends its results as blocks too, 1 if it adds them to
+  *           the tally itself
+  * @param blocks
+  *           is the communicator the blocks travel on
+  * @param stops
+  *           is the communicator the senders wait for stops on
+  * @param options
+  *           is the command line options
+  */
+void coordinatorCreate(Coordinator *coordinator, int firstRank,
+      MPI::Intracomm &blocks, MPI::Intracomm &stops, const Options *options)
+{
+   double normalQuantile(double);
+
+   inboxCreate(&coordinator->inbox, firstRank, blocks);
+   coordinator->stops = stops;
+   memset(&coordinator->tally, 0, sizeof(coordinator->tally));
+   coordinator->local = firstRank > 0;
+   coordinator->relay = false;
+   coordinator->closed = false;
+   coordinator->precision = options->precision;
+   coordinator->z = normalQuantile(options->confidence / 100);
+   coordinator->stopped = false;
+   coordinator->done = false;
+} // coordinatorCreate
+
+
+/**
+  * Turns a coordinator into a relay below another coordinator. Counts are
+  * passed on in blocks of about blockSize simulations.
+  *
+  * @param coordinator
+  *           is the coordinator
+  * @param blockSize
+  *           is the number of simulations in a full block
+  * @param blocks
+  *           is the communicator blocks to the coordinator above travel on
+  * @param stops
+  *           is the communicator the stop from above comes on
+  */
+void coordinatorLink(Coordinator *coordinator, int blockSize,
+      MPI::Intracomm &blocks, MPI::Intracomm &stops)
+{
+   coordinator->relay = true;
+   outboxCreate(&coordinator->up, blockSize, blocks);
+   coordinator->upStops = stops;
+} // coordinatorLink
+
+
+/**
+  * Sends every sender of a coordinator its stop.
+  *
+  * @param coordinator
+  *           is the coordinator
+  */
+void coordinatorSendStops(Coordinator *coordinator)
+{
+   int j; /* loop counter */
+
+   for (j = coordinator->inbox.firstRank; j < coordinator->stops.Get_size();
+         j++)
+      coordinator->stops.Send(NULL, 0, MPI::INTEGER, j, STOP_TAG);
+} // coordinatorSendStops
+
+
+/**
+  * Makes whatever progress a coordinator can without waiting. It adds up
+  * the blocks that have arrived. At the top of the tree it stops the
+  * campaign once the outcome percentages are precise enough. A relay passes
+  * its counts and its last block up and the stop from above down. Every
+  * sender gets exactly one stop in an adaptive campaign, when it stops or
+  * after the sender's last block.
+  *
+  * @param coordinator
+  *           is the coordinator
+  * @return the number of blocks and stops that arrived
+  */
+int coordinatorStep(Coordinator *coordinator)
+{
+   int progress; /* number of blocks and stops that arrived */
+   bool adaptive = coordinator->precision > 0;
+   bool allIn; /* whether every result has been added to the tally */
+
+   if (coordinator->done)
+      return 0;
+   progress = inboxPoll(&coordinator->inbox, &coordinator->tally);
+   allIn = coordinator->inbox.active == 0 && !coordinator->local;
+
+   if (!coordinator->relay)
+   {
+      if (!coordinator->stopped && campaignPrecise(&coordinator->tally,
+            coordinator->precision, coordinator->z))
+      {
+         coordinatorSendStops(coordinator);
+         coordinator->stopped = true;
+      }
+      if (allIn)
+      {
+         if (adaptive && !coordinator->stopped)
+            coordinatorSendStops(coordinator);
+         coordinator->done = true;
+      }
+      return progress;
+   }
+
+   if (!coordinator->closed)
+   {
+      outboxAdd(&coordinator->up, &coordinator->tally);
+      memset(&coordinator->tally, 0, sizeof(coordinator->tally));
+      if (allIn)
+      {
+         outboxFinish(&coordinator->up);
+         coordinator->closed = true;
+      }
+   }
+   if (adaptive && !coordinator->stopped
+         && coordinator->upStops.Iprobe(0, STOP_TAG))
+   {
+      coordinator->upStops.Recv(NULL, 0, MPI::INTEGER, 0, STOP_TAG);
+      coordinatorSendStops(coordinator);
+      coordinator->stopped = true;
+      progress = progress + 1;
+   }
+   coordinator->done = coordinator->closed
+         && (!adaptive || coordinator->stopped);
+   return progress;
+} // coordinatorStep
+
+
+/**
+  * Steps a rank's coordinators until they are done, sleeping between
+  * steps that make no progress. Waiting inside MPI instead would spin on
+  * the core the rank simulates on.
+  *
+  * @param group
+  *           is the coordinator of the rank's group
+  * @param top
+  *           is the coordinator above the group leaders, or NULL
+  */
+void coordinatorsFinish(Coordinator *group, Coordinator *top)
+{
+   while (!group->done || (top != NULL && !top->done))
+   {
+      int progress = coordinatorStep(group); /* blocks and stops */
+
+      if (top != NULL)
+         progress = progress + coordinatorStep(top);
+      if (progress == 0)
+         usleep(COORDINATOR_POLL_US);
+   }
+} // coordinatorsFinish
+
+
+/**
+  * Frees what coordinatorCreate allocated.
+  *
+  * @param coordinator
+  *           is the coordinator
+  */
+void coordinatorDestroy(Coordinator *coordinator)
+{
+   inboxDestroy(&coordinator->inbox);
+} // coordinatorDestroy
+
+
+/**
+  * Writes out everything waiting in a rank's log.
+  *
+  * @param log
+  *           is the log
+  */
+void logFlush(RankLog *log)
+{
+   if (log->used > 0)
+   {
+      fflush(stdout);
+      if (write(STDOUT_FILENO, log->data, log->used) < 0)
+         perror("write");
+      log->used = 0;
+   }
+} // logFlush
+
+
+/**
+  * Adds a formatted line to a rank's log, writing the log out first if the
+  * line would not fit.
+  *
+  * @param log
+  *           is the log
+  * @param format
+  *           is a printf format, followed by its arguments
+  */
+void logPrintf(RankLog *log, const char *format, ...)
+{
+   char line[256]; /* the formatted line */
+   va_list args;
+   int length;
+
+   va_start(args, format);
+   length = vsnprintf(line, sizeof(line), format, args);
+   va_end(args);
+   if (length < 0)
+      return;
+   if ((size_t) length >= sizeof(line))
+      length = sizeof(line) - 1;
+
+   if (log->used + length > LOG_BUFFER_SIZE)
+      logFlush(log);
+   memcpy(log->data + log->used, line, length);
+   log->used = log->used + length;
+} // logPrintf
+
+
+/**
+  * Writes the values in a series recorder's ring to its file as they arrive.
+  * This is the body of the recorder's writer thread. It sleeps until a batch
+  * is ready or the recorder is done, and writes whole contiguous stretches of
+  * the ring with one fwrite each.
+  *
+  * @param series
+  *           is the recorder
+  */
+void seriesDrain(SeriesRecorder *series)
+{
+   for (;;)
+   {
+      size_t head;
+      size_t tail = series->tail.load(std::memory_order_relaxed);
+      bool done;
+
+      {
+         std::unique_lock<std::mutex> guard(series->lock);
+
+         while (!series->done.load()
+               && series->head.load() - tail < SERIES_BATCH)
+            series->wake.wait(guard);
+      }
+      done = series->done.load();
+      head = series->head.load(std::memory_order_acquire);
+
+      while (tail < head)
+      {
+         size_t start = tail % SERIES_CAPACITY;
+         size_t count = head - tail;
+
+         if (count > SERIES_CAPACITY - start)
+            count = SERIES_CAPACITY - start;
+         fwrite(series->ring + start, sizeof(int32_t), count, series->file);
+         tail = tail + count;
+
+         // A pusher checks for a full ring under the lock before it waits,
+         // so storing the tail and waking it under the lock cannot slip in
+         // between the two.
+         std::lock_guard<std::mutex> guard(series->lock);
+
+         series->tail.store(tail, std::memory_order_release);
+         series->wake.notify_all();
+      }
+
+      if (done)
+         return;
+   }
+} // seriesDrain
+
+
+/**
+  * Opens a rank's series file, "<prefix>.<rank>", and starts its writer
+  * thread.
+  *
+  * @param series
+  *           is the recorder to set up
+  * @param prefix
+  *           is the path the rank number is appended to
+  * @param rank
+  *           is this rank
+  */
+void seriesCreate(SeriesRecorder *series, const char *prefix, int rank)
+{
+   char path[1024]; /* the rank's file */
+   int32_t header[4] = { 0, 0, rank, 0 };
+
+   snprintf(path, sizeof(path), "%s.%d", prefix, rank);
+   series->file = fopen(path, "wb");
+   if (series->file == NULL)
+   {
+      perror(path);
+      MPI::COMM_WORLD.Abort(1);
+   }
+   memcpy(header, "LIFESER1", 8);
+   fwrite(header, sizeof(header), 1, series->file);
+
+   series->ring = new int32_t[SERIES_CAPACITY];
+   series->head = 0;
+   series->tail = 0;
+   series->done = false;
+   series->writer = std::thread(seriesDrain, series);
+} // seriesCreate
+
+
+/**
+  * Adds a digest of a grid's cells to a trace. Steps past the end of the
+  * trace are not kept.
+  *
+  * @param trace
+  *           is the trace
+  * @param grid
+  *           is the grid
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  */
+void traceGrid(GridTrace *trace, const int *grid, int nx, int ny)
+{
+   uint64_t hash = 14695981039346656037ULL; /* FNV-1a offset basis */
+   int i, j; /* loop counters */
+
+   if (trace->count == STEPS_MAX)
+      return;
+   for (i = 1; i <= nx; i++)
+   {
+      for (j = 1; j <= ny; j++)
+         hash = (hash ^ (uint32_t) ROW(grid, ny, i)[j]) * 1099511628211ULL;
+   }
+   trace->digests[trace->count] = hash;
+   trace->count = trace->count + 1;
+} // traceGrid
+
+
+/**
+  * Appends a value to a series recorder. This only waits if the writer has
+  * fallen a whole ring behind.
+  *
+  * @param series
+  *           is the recorder
+  * @param value
+  *           is the value to append
+  */
+void seriesPush(SeriesRecorder *series, int32_t value)
+{
+   size_t head = series->head.load(std::memory_order_relaxed);
+
+   if (head - series->tail.load(std::memory_order_acquire) == SERIES_CAPACITY)
+   {
+      std::unique_lock<std::mutex> guard(series->lock);
+
+      series->wake.notify_all();
+      while (head - series->tail.load() == SERIES_CAPACITY)
+         series->wake.wait(guard);
+   }
+   series->ring[head % SERIES_CAPACITY] = value;
+   series->head.store(head + 1, std::memory_order_release);
+
+   if ((head + 1) % SERIES_BATCH == 0)
+   {
+      std::lock_guard<std::mutex> guard(series->lock);
+
+      series->wake.notify_all();
+   }
+} // seriesPush
+
+
+/**
+  * Writes out whatever is left in a series recorder, stops its writer thread
+  * and closes its file.
+  *
+  * @param series
+  *           is the recorder
+  */
+void seriesDestroy(SeriesRecorder *series)
+{
+   {
+      std::lock_guard<std::mutex> guard(series->lock);
+
+      series->done = true;
+      series->wake.notify_all();
+   }
+   series->writer.join();
+   fclose(series->file);
+   delete[] series->ring;
+} // seriesDestroy
+
+
+/**
+  * Allocates room for a rank's per-simulation records.
+  *
+  * @param records
+  *           is the structure to set up
+  * @param capacity
+  *           is the most simulations the rank may run
+  */
+void recordsCreate(SimulationRecords *records, int capacity)
+{
+   records->count = 0;
+   records->capacity = capacity;
+   records->wallTime = new double[capacity]();
+   records->simulation = new int32_t[capacity]();
+   records->seed = new int32_t[capacity]();
+   records->steps = new int32_t[capacity]();
+   records->vegetation = new int32_t[capacity]();
+   records->outcome = new uint8_t[capacity]();
+} // recordsCreate
+
+
+/**
+  * Makes room for at least the given number of records, keeping those
+  * already held.
+  *
+  * @param records
+  *           is the records
+  * @param capacity
+  *           is the number of records to make room for
+  */
+void recordsReserve(SimulationRecords *records, int capacity)
+{
+   SimulationRecords bigger; /* the records with more room */
+   void recordsDestroy(SimulationRecords*);
+
+   if (capacity <= records->capacity)
+      return;
+   if (capacity < 2 * records->capacity)
+      capacity = 2 * records->capacity;
+   recordsCreate(&bigger, capacity);
+   bigger.count = records->count;
+   memcpy(bigger.wallTime, records->wallTime, records->count * sizeof(double));
+   memcpy(bigger.simulation, records->simulation,
+         records->count * sizeof(int32_t));
+   memcpy(bigger.seed, records->seed, records->count * sizeof(int32_t));
+   memcpy(bigger.steps, records->steps, records->count * sizeof(int32_t));
+   memcpy(bigger.vegetation, records->vegetation,
+         records->count * sizeof(int32_t));
+   memcpy(bigger.outcome, records->outcome, records->count * sizeof(uint8_t));
+   recordsDestroy(records);
+   *records = bigger;
+} // recordsReserve
+
+
+/**
+  * Writes one column of a rank's records. The file view scatters the
+  * rank's entries to the places of their simulations in the column.
+  *
+  * @param file
+  *           is the records file
+  * @param column
+  *           is the offset of the column in the file
+  * @param data
+  *           is the rank's entries of the column
+  * @param count
+  *           is the number of entries
+  * @param places
+  *           is the index in the column of each entry
+  * @param type
+  *           is the type of the entries
+  */
+void recordsWriteColumn(MPI::File &file, MPI::Offset column, const void *data,
+      int count, const int *places, const MPI::Datatype &type)
+{
+   MPI::Datatype scatter; /* the rank's places in the column */
+
+   scatter = type.Create_indexed_block(count, 1, places);
+   scatter.Commit();
+   file.Set_view(column, type, scatter, "native", MPI::INFO_NULL);
+   file.Write_all(data, count, type);
+   scatter.Free();
+} // recordsWriteColumn
+
+
+/**
+  * Finds where the column after a given one starts. Columns are padded to
+  * 8 bytes, so that a reader can map the file and use every column in place
+  * whatever the number of records.
+  *
+  * @param column
+  *           is the offset of the column in the file
+  * @param n
+  *           is the number of entries in the column
+  * @param size
+  *           is the size of an entry
+  * @return the offset of the next column
+  */
+MPI::Offset recordsNextColumn(MPI::Offset column, MPI::Offset n, size_t size)
+{
+   return (column + n * (MPI::Offset) size + 7) & ~(MPI::Offset) 7;
+} // recordsNextColumn
+
+
+/**
+  * Writes the records file with MPI-IO. Every rank must call this. The
+  * master writes the header, and every rank writes its own entries of each
+  * column with one collective write, so no data passes through the master.
+  *
+  * @param records
+  *           is this rank's records
+  * @param path
+  *           is the file to write
+  * @param header
+  *           is the header of the file, the same on every rank
+  */
+void recordsWrite(SimulationRecords *records, const char *path,
+      RecordFileHeader *header)
+{
+   MPI::File file;
+   MPI::Offset column; /* offset of the column being written */
+   MPI::Offset n = header->numRecords; /* entries per column */
+   int *places; /* index in the columns of each of the rank's records */
+   int i; /* loop counter */
+
+   file = MPI::File::Open(MPI::COMM_WORLD, path,
+         MPI::MODE_CREATE | MPI::MODE_WRONLY, MPI::INFO_NULL);
+   // Truncate first, so that the padding reads as zeros even when an older
+   // file is overwritten.
+   column = recordsNextColumn(sizeof(*header), n, sizeof(double));
+   for (i = 0; i < 4; i++)
+      column = recordsNextColumn(column, n, sizeof(int32_t));
+   file.Set_size(0);
+   file.Set_size(recordsNextColumn(column, n, sizeof(uint8_t)));
+
+   if (MPI::COMM_WORLD.Get_rank() == 0)
+      file.Write_at(0, header, sizeof(*header), MPI::BYTE);
+
+   places = new int[records->count + 1];
+   for (i = 0; i < records->count; i++)
+      places[i] = records->simulation[i] - 1;
+
+   column = sizeof(*header);
+   recordsWriteColumn(file, column, records->wallTime, records->count,
+         places, MPI::DOUBLE);
+   column = recordsNextColumn(column, n, sizeof(double));
+   recordsWriteColumn(file, column, records->simulation, records->count,
+         places, MPI::INT);
+   column = recordsNextColumn(column, n, sizeof(int32_t));
+   recordsWriteColumn(file, column, records->seed, records->count, places,
+         MPI::INT);
+   column = recordsNextColumn(column, n, sizeof(int32_t));
+   recordsWriteColumn(file, column, records->steps, records->count, places,
+         MPI::INT);
+   column = recordsNextColumn(column, n, sizeof(int32_t));
+   recordsWriteColumn(file, column, records->vegetation, records->count,
+         places, MPI::INT);
+   column = recordsNextColumn(column, n, sizeof(int32_t));
+   recordsWriteColumn(file, column, records->outcome, records->count,
+         places, MPI::BYTE);
+
+   file.Close();
+   delete[] places;
+} // recordsWrite
+
+
+/**
+  * Frees a rank's per-simulation records.
+  *
+  * @param records
+  *           is the structure to free
+  */
+void recordsDestroy(SimulationRecords *records)
+{
+   delete[] records->wallTime;
+   delete[] records->simulation;
+   delete[] records->seed;
+   delete[] records->steps;
+   delete[] records->vegetation;
+   delete[] records->outcome;
+} // recordsDestroy
+
+
+/**
+  * Pins the calling thread to one CPU of those it is currently allowed to run
+  * on. With the "compact" policy consecutive slots fill one socket before
+  * moving to the next. With "scatter" consecutive slots alternate between
+  * sockets, so that ranks spread their memory traffic over every socket.
+  *
+  * @param policy
+  *           is the pinning policy, "compact" or "scatter"
+  * @param slot
+  *           is the index of the thread among those sharing the node, for
+  *           example the node-local rank
+  * @return whether the thread was pinned
+  */
+bool pinThread(const char *policy, int slot)
+{
+   cpu_set_t allowed; /* CPUs the launcher lets this process use */
+   cpu_set_t target; /* the CPU chosen for this thread */
+   int cpus[CPU_SETSIZE]; /* allowed CPUs in the order the policy uses */
+   int sockets[CPU_SETSIZE]; /* socket of each entry in cpus */
+   int ncpus; /* number of allowed CPUs */
+   int cpu; /* loop counter */
+
+   if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      return false;
+
+   ncpus = 0;
+   for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+   {
+      if (CPU_ISSET(cpu, &allowed))
+      {
+         char path[128]; /* sysfs file holding the socket of the CPU */
+         FILE *file;
+
+         sockets[ncpus] = 0;
+         snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+               cpu);
+         file = fopen(path, "r");
+         if (file != NULL)
+         {
+            if (fscanf(file, "%d", &sockets[ncpus]) != 1)
+               sockets[ncpus] = 0;
+            fclose(file);
+         }
+         cpus[ncpus] = cpu;
+         ncpus = ncpus + 1;
+      }
+   }
+   if (ncpus == 0)
+      return false;
+
+   if (strcmp(policy, "compact") == 0)
+   {
+      // Sort by socket, keeping CPU order within a socket.
+      for (int a = 1; a < ncpus; a++)
+      {
+         for (int b = a; b > 0 && sockets[b - 1] > sockets[b]; b--)
+         {
+            int t = sockets[b]; sockets[b] = sockets[b - 1]; sockets[b - 1] = t;
+            t = cpus[b]; cpus[b] = cpus[b - 1]; cpus[b - 1] = t;
+         }
+      }
+   }
+   else if (strcmp(policy, "scatter") == 0)
+   {
+      // Deal the CPUs out round-robin over the sockets: take the n-th CPU
+      // of every socket before the (n + 1)-th CPU of any socket.
+      int order[CPU_SETSIZE]; /* cpus rearranged for scattering */
+      int rounds[CPU_SETSIZE]; /* position of each CPU within its socket */
+      int n = 0;
+
+      for (int a = 0; a < ncpus; a++)
+      {
+         rounds[a] = 0;
+         for (int b = 0; b < a; b++)
+         {
+            if (sockets[b] == sockets[a])
+               rounds[a] = rounds[a] + 1;
+         }
+      }
+      for (int round = 0; n < ncpus; round++)
+      {
+         for (int a = 0; a < ncpus; a++)
+         {
+            if (rounds[a] == round)
+               order[n++] = cpus[a];
+         }
+      }
+      memcpy(cpus, order, ncpus * sizeof(int));
+   }
+   else
+   {
+      return false;
+   }
+
+   CPU_ZERO(&target);
+   CPU_SET(cpus[slot % ncpus], &target);
+   return sched_setaffinity(0, sizeof(target), &target) == 0;
+} // pinThread
+
+
+/**
+  * Computes the size of a grid, halo included, rounded up to a cache line.
+  *
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @return the size of the grid in bytes
+  */
+size_t gridBytes(int nx, int ny)
+{
+   size_t bytes = (size_t) (nx + 2) * (ny + 2) * sizeof(int);
+
+   return (bytes + 63) & ~(size_t) 63;
+} // gridBytes
+
+
+/**
+  * Computes the number of 64-bit words in each plane of a row of a bitsliced
+  * grid. Column j of the grid, halo included, is bit j of the row.
+  *
+  * @param ny
+  *           is the y dimension of the grid
+  * @return the number of words
+  */
+int sliceWords(int ny)
+{
+   return (ny + 2 + 63) / 64;
+} // sliceWords
+
+
+/**
+  * Computes the memory the bitsliced engine needs: two bitsliced grids and
+  * the two partial sums of a row. Narrow grids need more of it than an int
+  * grid does, since every row takes at least a word per plane.
+  *
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @return the size in bytes
+  */
+size_t sliceBytes(int nx, int ny)
+{
+   size_t words = sliceWords(ny); /* words per plane of a row */
+
+   return (2 * (size_t) (nx + 2) * SLICE_PLANES + 11) * words
+         * sizeof(uint64_t);
+} // sliceBytes
+
+
+/**
+  * Computes the size of a grid pool slot: a grid plus the two rows of
+  * scratch space that the Sum policies use, which follow the grid, or what
+  * the bitsliced engine needs if that is more.
+  *
+  * @param nx
+  *           is the x dimension of the largest grid
+  * @param ny
+  *           is the y dimension of the largest grid
+  * @return the size of a slot in bytes
+  */
+size_t slotBytes(int nx, int ny)
+{
+   size_t sliceBytes(int, int);
+   size_t bytes = gridBytes(nx, ny) + gridBytes(0, ny);
+
+   return bytes > sliceBytes(nx, ny) ? bytes : sliceBytes(nx, ny);
+} // slotBytes
+
+
+/**
+  * Counts the grid pool slots a rank holds at once: its grid and the next
+  * grid of the kernel, one more to encode snapshots in while the kernel
+  * runs, and with "-engine auto" one more to time the engines on. The
+  * baseline job needs two, as the original grid and tempGrid did.
+  *
+  * @param options
+  *           is the command line options
+  * @return the number of slots, at most POOL_SLOTS_MAX
+  */
+int poolSlots(const Options *options)
+{
+   int slots = 2; /* the grid and the kernel's next grid */
+
+   if (options->snapshots.prefix != NULL
+         || strcmp(options->engineName, "auto") == 0)
+      slots = slots + 1;
+   return slots;
+} // poolSlots
+
+
+/**
+  * Maps the memory for an arena on the NUMA node of the calling thread. 1 GB
+  * and then 2 MB huge pages are tried first. If the system has none reserved,
+  * ordinary pages are mapped and the kernel is asked to back them with
+  * transparent huge pages. The memory is zeroed here, so that with
+  * first-touch placement every page is faulted in by the thread that will use
+  * it.
+  *
+  * @param arena
+  *           is the arena to set up
+  * @param bytes
+  *           is the number of bytes the arena must hold
+  */
+void arenaCreate(GridArena *arena, size_t bytes)
+{
+   void *memory = MAP_FAILED;
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+   arena->size = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+   arena->used = 0;
+
+# if defined(MAP_HUGETLB) && defined(MAP_HUGE_1GB)
+   if (arena->size >= (1UL << 30))
+   {
+      size_t size = (arena->size + (1UL << 30) - 1) & ~((1UL << 30) - 1);
+
+      memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            flags | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+      if (memory != MAP_FAILED)
+         arena->size = size;
+   }
+# endif
+# ifdef MAP_HUGETLB
+   if (memory == MAP_FAILED)
+      memory = mmap(NULL, arena->size, PROT_READ | PROT_WRITE,
+            flags | MAP_HUGETLB, -1, 0);
+# endif
+   if (memory != MAP_FAILED)
+   {
+      arena->pages = "hugetlb";
+   }
+   else
+   {
+      memory = mmap(NULL, arena->size, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (memory == MAP_FAILED)
+      {
+         fprintf(stderr, "Out of memory mapping a %lu byte grid arena\n",
+               (unsigned long) arena->size);
+         MPI::COMM_WORLD.Abort(1);
+      }
+      arena->pages = "normal";
+# ifdef MADV_HUGEPAGE
+      if (madvise(memory, arena->size, MADV_HUGEPAGE) == 0)
+         arena->pages = "transparent";
+# endif
+   }
+   arena->base = (char*) memory;
+
+# ifdef USE_NUMA
+   if (numa_available() >= 0)
+      numa_setlocal_memory(arena->base, arena->size);
+# endif
+   memset(arena->base, 0, arena->size);
+} // arenaCreate
+
+
+/**
+  * Hands out zeroed memory from an arena. Memory is only given back all at
+  * once, when the arena is destroyed.
+  *
+  * @param arena
+  *           is the arena
+  * @param bytes
+  *           is the number of bytes wanted
+  * @return the memory, aligned to a cache line
+  */
+void *arenaAllocate(GridArena *arena, size_t bytes)
+{
+   char *memory = arena->base + arena->used;
+
+   bytes = (bytes + 63) & ~(size_t) 63;
+   if (arena->used + bytes > arena->size)
+   {
+      fprintf(stderr, "Grid arena exhausted: %lu of %lu bytes in use\n",
+            (unsigned long) arena->used, (unsigned long) arena->size);
+      MPI::COMM_WORLD.Abort(1);
+   }
+   arena->used = arena->used + bytes;
+   return memory;
+} // arenaAllocate
+
+
+/**
+  * Carves the slots of a grid pool out of an arena.
+  *
+  * @param pool
+  *           is the pool to set up
+  * @param arena
+  *           is the arena, with room for numSlots slots
+  * @param bytes
+  *           is the size of each slot, from slotBytes
+  * @param numSlots
+  *           is the number of slots, at most POOL_SLOTS_MAX
+  */
+void poolCreate(GridPool *pool, GridArena *arena, size_t bytes, int numSlots)
+{
+   int i; /* loop counter */
+
+   pool->slotBytes = bytes;
+   pool->numSlots = numSlots;
+   pool->numFree = 0;
+   for (i = 0; i < numSlots; i++)
+      pool->free[pool->numFree++] = arenaAllocate(arena, bytes);
+} // poolCreate
+
+
+/**
+  * Takes a slot from a grid pool.
+  *
+  * @param pool
+  *           is the pool
+  * @return the slot. Its contents are whatever the last user left there.
+  */
+int *poolAcquire(GridPool *pool)
+{
+   if (pool->numFree == 0)
+   {
+      fprintf(stderr, "Grid pool exhausted: all %d slots in use\n",
+            pool->numSlots);
+      MPI::COMM_WORLD.Abort(1);
+   }
+   pool->numFree = pool->numFree - 1;
+   return (int*) pool->free[pool->numFree];
+} // poolAcquire
+
+
+/**
+  * Returns a slot to a grid pool.
+  *
+  * @param pool
+  *           is the pool
+  * @param slot
+  *           is a slot taken with poolAcquire
+  */
+void poolRelease(GridPool *pool, int *slot)
+{
+   pool->free[pool->numFree] = slot;
+   pool->numFree = pool->numFree + 1;
+} // poolRelease
+
+
+/**
+  * Unmaps an arena.
+  *
+  * @param arena
+  *           is the arena
+  */
+void arenaDestroy(GridArena *arena)
+{
+   munmap(arena->base, arena->size);
+   arena->base = NULL;
+   arena->size = 0;
+   arena->used = 0;
+} // arenaDestroy
+
+
+/**
+  * Run-length encodes a chunk of cells as (count, value) byte pairs.
+  *
+  * @param cells
+  *           is the chunk
+  * @param n
+  *           is the number of cells in the chunk
+  * @param out
+  *           receives the pairs, and must have room for 2 * n bytes
+  * @return the number of bytes written to out
+  */
+size_t rleEncode(const uint8_t *cells, size_t n, uint8_t *out)
+{
+   size_t used = 0; /* bytes written to out */
+   size_t k = 0; /* cells consumed */
+
+   while (k < n)
+   {
+      uint8_t value = cells[k];
+      size_t run = 1;
+
+      while (k + run < n && run < 255 && cells[k + run] == value)
+         run = run + 1;
+      out[used++] = (uint8_t) run;
+      out[used++] = value;
+      k = k + run;
+   }
+   return used;
+} // rleEncode
+
+
+/**
+  * Writes a grid to a snapshot file named after the simulation and step.
+  * The cells are narrowed to bytes in a scratch slot taken from the grid
+  * pool, which also holds the chunk table and each compressed chunk.
+  *
+  * @param writer
+  *           is the snapshot settings
+  * @param grid
+  *           is the grid of vegetation values
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @param step
+  *           is the time step the grid holds
+  */
+void snapshotWrite(SnapshotWriter *writer, const int *grid, int nx, int ny,
+      int step)
+{
+   char path[1024]; /* the snapshot file */
+   SnapshotHeader header; /* the file's header */
+   size_t n = (size_t) nx * ny; /* number of cells */
+   uint8_t *cells; /* the cells as bytes */
+   int64_t *chunkBytes; /* sizes of the compressed chunks */
+   uint8_t *packed; /* space for one compressed chunk */
+   FILE *file;
+   int i, j; /* loop counters */
+   int *slot = poolAcquire(&gridPool);
+
+   cells = (uint8_t*) slot;
+   chunkBytes = (int64_t*) (cells + ((n + 7) & ~(size_t) 7));
+   packed = (uint8_t*) (chunkBytes
+         + (nx + SNAPSHOT_CHUNK_ROWS - 1) / SNAPSHOT_CHUNK_ROWS);
+   for (i = 1; i <= nx; i++)
+   {
+      const int *row = ROW(grid, ny, i);
+
+      for (j = 1; j <= ny; j++)
+         cells[(size_t) (i - 1) * ny + j - 1] = (uint8_t) row[j];
+   }
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, "LIFESNP1", 8);
+   header.nx = nx;
+   header.ny = ny;
+   header.simulation = writer->simulation;
+   header.step = step;
+   header.encoding = writer->encoding;
+
+   snprintf(path, sizeof(path), "%s.%d.%d.snp", writer->prefix,
+         writer->simulation, step);
+   file = fopen(path, "wb");
+   if (file == NULL)
+   {
+      perror(path);
+      poolRelease(&gridPool, slot);
+      return;
+   }
+
+   if (writer->encoding == SNAPSHOT_RAW)
+   {
+      header.payloadBytes = n;
+      fwrite(&header, sizeof(header), 1, file);
+      fwrite(cells, 1, n, file);
+   }
+   else
+   {
+      // Leave room for the chunk table, write the chunks, then go back and
+      // fill in the header and the table.
+      header.numChunks = (nx + SNAPSHOT_CHUNK_ROWS - 1) / SNAPSHOT_CHUNK_ROWS;
+      header.payloadBytes = header.numChunks * sizeof(int64_t);
+      fseek(file, sizeof(header) + header.numChunks * sizeof(int64_t),
+            SEEK_SET);
+      for (i = 0; i < header.numChunks; i++)
+      {
+         size_t first = (size_t) i * SNAPSHOT_CHUNK_ROWS * ny;
+         size_t count = (size_t) SNAPSHOT_CHUNK_ROWS * ny;
+
+         if (first + count > n)
+            count = n - first;
+# ifdef USE_ZSTD
+         if (writer->encoding == SNAPSHOT_ZSTD)
+         {
+            size_t bytes = ZSTD_compress(packed, ZSTD_compressBound(count),
+                  cells + first, count, 1);
+
+            if (ZSTD_isError(bytes))
+            {
+               fprintf(stderr, "zstd failed on %s\n", path);
+               MPI::COMM_WORLD.Abort(1);
+            }
+            chunkBytes[i] = bytes;
+         }
+         else
+# endif
+            chunkBytes[i] = rleEncode(cells + first, count, packed);
+         fwrite(packed, 1, chunkBytes[i], file);
+         header.payloadBytes = header.payloadBytes + chunkBytes[i];
+      }
+      fseek(file, 0, SEEK_SET);
+      fwrite(&header, sizeof(header), 1, file);
+      fwrite(chunkBytes, sizeof(int64_t), header.numChunks, file);
+   }
+
+   fclose(file);
+   poolRelease(&gridPool, slot);
+} // snapshotWrite
+
+
+/**
+  * Fills a grid from a snapshot file. The file is mapped rather than read,
+  * so raw snapshots are copied straight from the page cache into the grid.
+  *
+  * @param path
+  *           is the snapshot file
+  * @param grid
+  *           is the grid of vegetation values to fill
+  * @param nx
+  *           is the x dimension of the grid, which must match the snapshot
+  * @param ny
+  *           is the y dimension of the grid, which must match the snapshot
+  */
+void snapshotRead(const char *path, int *grid, int nx, int ny)
+{
+   struct stat info;
+   const SnapshotHeader *header;
+   const uint8_t *data; /* the mapped file */
+   const uint8_t *chunk; /* the compressed chunk being decoded */
+   const int64_t *chunkBytes; /* sizes of the compressed chunks */
+   int64_t end; /* offset in the file where the chunks read so far end */
+   bool valid; /* whether the chunk table fits in the file */
+   int i, j, k; /* loop counters */
+   int fd = open(path, O_RDONLY);
+
+   if (fd < 0 || fstat(fd, &info) != 0
+         || (size_t) info.st_size < sizeof(SnapshotHeader))
+   {
+      fprintf(stderr, "Cannot read snapshot %s\n", path);
+      MPI::COMM_WORLD.Abort(1);
+   }
+   data = (const uint8_t*) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+         fd, 0);
+   close(fd);
+   header = (const SnapshotHeader*) data;
+   if (data == MAP_FAILED || memcmp(header->magic, "LIFESNP1", 8) != 0
+         || header->nx != nx || header->ny != ny
+         || (int64_t) sizeof(*header) + header->payloadBytes > info.st_size)
+   {
+      fprintf(stderr, "%s is not a %d x %d snapshot\n", path, nx, ny);
+      MPI::COMM_WORLD.Abort(1);
+   }
+
+   if (header->encoding == SNAPSHOT_RAW)
+   {
+      const uint8_t *cells = data + sizeof(*header);
+
+      if (header->payloadBytes != (int64_t) nx * ny)
+      {
+         fprintf(stderr, "Corrupt snapshot %s\n", path);
+         MPI::COMM_WORLD.Abort(1);
+      }
+      for (i = 1; i <= nx; i++)
+      {
+         for (j = 1; j <= ny; j++)
+            ROW(grid, ny, i)[j] = cells[(size_t) (i - 1) * ny + j - 1];
+      }
+   }
+   else
+   {
+      // Check the encoding and that the chunk table and every chunk lie
+      // within the file before trusting any of the sizes.
+      chunkBytes = (const int64_t*) (data + sizeof(*header));
+      end = sizeof(*header) + (int64_t) header->numChunks * sizeof(int64_t);
+      valid = header->numChunks
+            == (nx + SNAPSHOT_CHUNK_ROWS - 1) / SNAPSHOT_CHUNK_ROWS
+            && end <= info.st_size;
+      for (k = 0; valid && k < header->numChunks; k++)
+      {
+         valid = chunkBytes[k] >= 0 && chunkBytes[k] <= info.st_size - end;
+         end = end + chunkBytes[k];
+      }
+# ifdef USE_ZSTD
+      valid = valid && (header->encoding == SNAPSHOT_RLE
+            || header->encoding == SNAPSHOT_ZSTD);
+# else
+      valid = valid && header->encoding == SNAPSHOT_RLE;
+# endif
+      if (!valid)
+      {
+         fprintf(stderr, "Corrupt or unsupported snapshot %s\n", path);
+         MPI::COMM_WORLD.Abort(1);
+      }
+      chunk = (const uint8_t*) (chunkBytes + header->numChunks);
+      i = 1;
+      j = 1;
+      for (k = 0; k < header->numChunks; k++)
+      {
+# ifdef USE_ZSTD
+         if (header->encoding == SNAPSHOT_ZSTD)
+         {
+            // Decode into a scratch slot, then widen into the grid.
+            int rows = nx - k * SNAPSHOT_CHUNK_ROWS;
+            size_t count;
+            uint8_t *cells;
+            int *slot = poolAcquire(&gridPool);
+
+            if (rows > SNAPSHOT_CHUNK_ROWS)
+               rows = SNAPSHOT_CHUNK_ROWS;
+            count = (size_t) rows * ny;
+            cells = (uint8_t*) slot;
+            if (ZSTD_decompress(cells, count, chunk, chunkBytes[k]) != count)
+            {
+               fprintf(stderr, "Corrupt zstd chunk in %s\n", path);
+               MPI::COMM_WORLD.Abort(1);
+            }
+            for (size_t c = 0; c < count; c++)
+            {
+               ROW(grid, ny, i)[j] = cells[c];
+               if (++j > ny)
+               {
+                  j = 1;
+                  i = i + 1;
+               }
+            }
+            poolRelease(&gridPool, slot);
+         }
+         else
+# endif
+         {
+            for (int64_t b = 0; b + 1 < chunkBytes[k] && i <= nx; b += 2)
+            {
+               for (int run = chunk[b]; run > 0 && i <= nx; run--)
+               {
+                  ROW(grid, ny, i)[j] = chunk[b + 1];
+                  if (++j > ny)
+                  {
+                     j = 1;
+                     i = i + 1;
+                  }
+               }
+            }
+         }
+         chunk = chunk + chunkBytes[k];
+      }
+
+      // The chunks must cover the grid exactly, or part of it would keep
+      // the cells of the previous simulation.
+      if (i != nx + 1 || j != 1)
+      {
+         fprintf(stderr, "Corrupt snapshot %s\n", path);
+         MPI::COMM_WORLD.Abort(1);
+      }
+   }
+
+   munmap((void*) data, info.st_size);
+} // snapshotRead
+
+
+/**
+  * Parses the header of a binary PGM file, skipping comments.
+  *
+  * @param text
+  *           is the start of the file, ending with a null byte
+  * @param fields
+  *           receives the width, height and maximum value
+  * @return the offset of the first sample
+  */
+off_t pgmHeader(const char *text, long fields[3])
+{
+   char *p = (char*) text + 2; /* past "P5" */
+
+   for (int f = 0; f < 3; f++)
+   {
+      while (*p == '#' || (*p != '\0' && strchr(" \t\r\n", *p) != NULL))
+      {
+         if (*p == '#')
+            p = p + strcspn(p, "\n");
+         else
+            p = p + 1;
+      }
+      fields[f] = strtol(p, &p, 10);
+   }
+   return (p - text) + 1; /* one whitespace byte ends the header */
+} // pgmHeader
+
+
+/**
+  * Finds the size of a PGM raster.
+  *
+  * @param path
+  *           is the raster file
+  * @param rows
+  *           receives the number of rows
+  * @param cols
+  *           receives the number of columns
+  * @return whether the file is a PGM. Raw rasters carry no size.
+  */
+bool rasterDimensions(const char *path, int *rows, int *cols)
+{
+   char text[4096]; /* start of the file, holding any PGM header */
+   long fields[3]; /* width, height and maximum value */
+   ssize_t length;
+   int fd = open(path, O_RDONLY);
+
+   if (fd < 0)
+      return false;
+   length = pread(fd, text, sizeof(text) - 1, 0);
+   close(fd);
+   text[length > 0 ? length : 0] = '\0';
+   if (length < 2 || text[0] != 'P' || text[1] != '5')
+      return false;
+
+   pgmHeader(text, fields);
+   *cols = fields[0];
+   *rows = fields[1];
+   return true;
+} // rasterDimensions
+
+
+/**
+  * Streams rows of a raster into memory. The raster is either a binary PGM
+  * ("P5", 8 or 16 bits per sample) with ny columns and nx rows, or a raw file
+  * of exactly nx * ny bytes. Only the requested rows are read, in chunks of
+  * about RASTER_CHUNK_BYTES, so a rank holding part of a grid never reads or
+  * buffers the rest of the file. Samples are scaled from the PGM's maximum
+  * value to 0..255, rounding up, so any non-zero sample stays non-zero.
+  *
+  * @param path
+  *           is the raster file
+  * @param nx
+  *           is the x dimension of the grid, the number of raster rows
+  * @param ny
+  *           is the y dimension of the grid, the number of raster columns
+  * @param firstRow
+  *           is the first row to read, counting from 0
+  * @param numRows
+  *           is the number of rows to read
+  * @param out
+  *           receives numRows * ny values
+  */
+void rasterLoad(const char *path, int nx, int ny, int firstRow, int numRows,
+      uint8_t *out)
+{
+   char text[4096]; /* start of the file, holding any PGM header */
+   off_t dataStart; /* offset of the first sample */
+   int sampleBytes; /* bytes per sample */
+   long maxValue; /* value of the brightest sample */
+   uint8_t *chunk; /* buffer for the rows being read */
+   size_t rowBytes; /* bytes per raster row */
+   int rowsPerChunk; /* rows read at a time */
+   struct stat info;
+   ssize_t length;
+   int row; /* first row of the chunk being read */
+   int fd = open(path, O_RDONLY);
+
+   if (fd < 0 || fstat(fd, &info) != 0)
+   {
+      fprintf(stderr, "Cannot read raster %s\n", path);
+      MPI::COMM_WORLD.Abort(1);
+   }
+   length = pread(fd, text, sizeof(text) - 1, 0);
+   text[length > 0 ? length : 0] = '\0';
+
+   if (length >= 2 && text[0] == 'P' && text[1] == '5')
+   {
+      long fields[3]; /* width, height and maximum value */
+
+      dataStart = pgmHeader(text, fields);
+      if (fields[0] != ny || fields[1] != nx || fields[2] < 1
+            || fields[2] > 65535)
+      {
+         fprintf(stderr, "%s is not a %d x %d PGM\n", path, nx, ny);
+         MPI::COMM_WORLD.Abort(1);
+      }
+      maxValue = fields[2];
+      sampleBytes = maxValue > 255 ? 2 : 1;
+   }
+   else
+   {
+      maxValue = 255;
+      sampleBytes = 1;
+      dataStart = 0;
+   }
+
+   rowBytes = (size_t) ny * sampleBytes;
+   if (info.st_size < dataStart + (off_t) (rowBytes * nx))
+   {
+      fprintf(stderr, "%s is too short for a %d x %d raster\n", path, nx, ny);
+      MPI::COMM_WORLD.Abort(1);
+   }
+
+   rowsPerChunk = RASTER_CHUNK_BYTES / rowBytes;
+   if (rowsPerChunk < 1)
+      rowsPerChunk = 1;
+   chunk = new uint8_t[rowsPerChunk * rowBytes];
+
+   for (row = 0; row < numRows; row = row + rowsPerChunk)
+   {
+      int rows = numRows - row < rowsPerChunk ? numRows - row : rowsPerChunk;
+      size_t bytes = rows * rowBytes;
+      size_t n = (size_t) rows * ny; /* samples in the chunk */
+      uint8_t *dest = out + (size_t) row * ny;
+
+      if (pread(fd, chunk, bytes, dataStart + (firstRow + row) * rowBytes)
+            != (ssize_t) bytes)
+      {
+         fprintf(stderr, "Error reading %s\n", path);
+         MPI::COMM_WORLD.Abort(1);
+      }
+      for (size_t k = 0; k < n; k++)
+      {
+         long value = sampleBytes == 2 ? (chunk[2 * k] << 8) | chunk[2 * k + 1]
+               : chunk[k];
+
+         dest[k] = (uint8_t) ((value * 255 + maxValue - 1) / maxValue);
+      }
+   }
+
+   delete[] chunk;
+   close(fd);
+} // rasterLoad
+
+
+/**
+  * Prepares a probability map for grids of the given size, all but its
+  * raster. For a file map this finds the size of the raster and works out
+  * which raster column covers each grid column. A PGM raster may have any
+  * size. A raw raster must be nx * ny bytes.
+  *
+  * @param map
+  *           is the map
+  * @param nx
+  *           is the x dimension of the grids
+  * @param ny
+  *           is the y dimension of the grids
+  */
+void probabilityMapSize(ProbabilityMap *map, int nx, int ny)
+{
+   int j; /* loop counter */
+
+   for (j = 0; j < 256; j++)
+      map->weightOf[j] = j / 255.0;
+   if (map->kind != PROB_FILE)
+      return;
+
+   if (!rasterDimensions(map->path, &map->rows, &map->cols))
+   {
+      map->rows = nx;
+      map->cols = ny;
+   }
+   map->tileOfColumn = new int[ny + 1];
+   for (j = 1; j <= ny; j++)
+      map->tileOfColumn[j] = (int) ((long) (j - 1) * map->cols / ny);
+} // probabilityMapSize
+
+
+/**
+  * Prepares a probability map for grids of the given size, and streams in
+  * its raster.
+  *
+  * @param map
+  *           is the map
+  * @param nx
+  *           is the x dimension of the grids
+  * @param ny
+  *           is the y dimension of the grids
+  */
+void probabilityMapLoad(ProbabilityMap *map, int nx, int ny)
+{
+   probabilityMapSize(map, nx, ny);
+   if (map->kind != PROB_FILE)
+      return;
+
+   map->tiles = new uint8_t[(size_t) map->rows * map->cols];
+   rasterLoad(map->path, map->rows, map->cols, 0, map->rows, map->tiles);
+} // probabilityMapLoad
+
+
+/**
+  * Frees what probabilityMapLoad allocated.
+  *
+  * @param map
+  *           is the map
+  */
+void probabilityMapDestroy(ProbabilityMap *map)
+{
+   delete[] map->tiles;
+   delete[] map->tileOfColumn;
+   map->tiles = NULL;
+   map->tileOfColumn = NULL;
+} // probabilityMapDestroy
+
+
+/**
+  * Initializes an empty grid given grid dimensions, a seed, and vegetation
+  * probability.
+  *
+  * @param grid
+  *           is a grid of vegetation values
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @param seed
+  *           is a random number seed
+  * @param prob
+  *           is the population probability
+  * @param landscape
+  *           is a terrain mask of nx * ny values, or NULL. Cells whose mask
+  *           value is 0 start without vegetation.
+  * @param map
+  *           is the probability map, which scales prob cell by cell
+  */
+void initializeGrid(int *grid, int nx, int ny, int seed, double prob,
+      const uint8_t *landscape, const ProbabilityMap *map)
+{
+   int i, j; /* loop counters */
+   double rowProb; /* population probability of the row, before tiles */
+   const uint8_t *tiles; /* raster row covering the grid row, or NULL */
+   double rand1(int);
+
+   // Every cell still draws rand1(seed + index) with index = ny * i + j, so
+   // a cell's value depends only on the seed, its position and its
+   // probability. The sum wraps around at 32 bits, as simulationSeed does.
+   for (i = 1; i <= nx; i++)
+   {
+      int *row = ROW(grid, ny, i);
+
+      rowProb = prob;
+      tiles = NULL;
+      if (map->kind == PROB_GRADIENT)
+      {
+         double t = nx > 1 ? (double) (i - 1) / (nx - 1) : 0;
+
+         rowProb = prob * (map->from + (map->to - map->from) * t);
+      }
+      else if (map->kind == PROB_FILE)
+      {
+         tiles = map->tiles
+               + (size_t) ((long) (i - 1) * map->rows / nx) * map->cols;
+      }
+
+      if (tiles == NULL)
+      {
+         for (j = 1; j <= ny; j++)
+            row[j] = rand1((int32_t) ((uint32_t) seed + ny * i + j))
+                  <= rowProb;
+      }
+      else
+      {
+         for (j = 1; j <= ny; j++)
+         {
+            row[j] = rand1((int32_t) ((uint32_t) seed + ny * i + j))
+                  <= rowProb * map->weightOf[tiles[map->tileOfColumn[j]]];
+         }
+      }
+      if (landscape != NULL)
+      {
+         const uint8_t *mask = landscape + (size_t) (i - 1) * ny;
+
+         for (j = 1; j <= ny; j++)
+         {
+            if (mask[j - 1] == 0)
+               ROW(grid, ny, i)[j] = 0;
+         }
+      }
+   }
+} // initializeGrid
+
+
+/**
+  * Starts tracking the vegetation of a simulation.
+  *
+  * @param tracker
+  *           is the tracker to start
+  */
+void convergenceStart(ConvergenceTracker *tracker)
+{
+   tracker->oldVegies[0] = -1;
+   tracker->oldVegies[1] = -1;
+   tracker->oldVegies[2] = -1;
+   tracker->numUnchanged = 0;
+} // convergenceStart
+
+
+/**
+  * Records the vegetation of a time step and tells whether the simulation has
+  * settled.
+  *
+  * @param tracker
+  *           is the tracker
+  * @param vegies
+  *           is the total amount of vegetation this step
+  * @param maxUnchanged
+  *           is the max # of timesteps with no vegetation change to simulate
+  * @return true if the vegetation has stabilized
+  */
+bool convergenceCheck(ConvergenceTracker *tracker, int vegies,
+      int maxUnchanged)
+{
+   if (vegies == tracker->oldVegies[0] || vegies == tracker->oldVegies[1]
+         || vegies == tracker->oldVegies[2])
+      tracker->numUnchanged = tracker->numUnchanged + 1;
+   else
+      tracker->numUnchanged = 0;
+   tracker->oldVegies[2] = tracker->oldVegies[1];
+   tracker->oldVegies[1] = tracker->oldVegies[0];
+   tracker->oldVegies[0] = vegies;
+   return tracker->numUnchanged >= maxUnchanged;
+} // convergenceCheck
+
+
+/**
+  * Tells whether the observers of a time step look at the grid, rather than
+  * only at the vegetation total. Kernels that keep the cells in another form
+  * only need to fill in the grid for those steps.
+  *
+  * @param hooks
+  *           are the observers, or NULL
+  * @param step
+  *           is the time step
+  * @return true if the grid must be up to date for runStepHooks
+  */
+bool stepHooksNeedGrid(const StepHooks *hooks, int step)
+{
+   return hooks != NULL && (hooks->trace != NULL
+         || (hooks->snapshots != NULL && hooks->snapshots->every > 0
+               && step % hooks->snapshots->every == 0));
+} // stepHooksNeedGrid
+
+
+/**
+  * Calls the observers of a time step.
+  *
+  * @param hooks
+  *           are the observers, or NULL
+  * @param grid
+  *           is the grid at this step
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @param step
+  *           is the time step
+  * @param vegies
+  *           is the total amount of vegetation this step
+  */
+void runStepHooks(StepHooks *hooks, const int *grid, int nx, int ny, int step,
+      int vegies)
+{
+   if (hooks != NULL && hooks->series != NULL)
+      seriesPush(hooks->series, vegies);
+   if (hooks != NULL && hooks->trace != NULL)
+      traceGrid(hooks->trace, grid, nx, ny);
+   if (hooks != NULL && hooks->snapshots != NULL
+         && hooks->snapshots->every > 0 && step % hooks->snapshots->every == 0)
+      snapshotWrite(hooks->snapshots, grid, nx, ny, step);
+} // runStepHooks
+
+
+/**
+  * Runs a simulation of the game of life given an initialized grid,
+  * dimensions, and loop restrictions. The Update template argument carries
+  * the growth rule, so every rule variant gets its own specialised kernel,
+  * and chooses how the rule is applied to each row. The Sum argument chooses
+  * how the neighbour sums are computed.
+  *
+  * @param grid
+  *           is a grid of vegetation values
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @param maxSteps
+  *           is the max # of timesteps to simulate
+  * @param maxUnchanged
+  *           is the max # of timesteps with no vegetation change to simulate
+  * @param pvegies
+  *           is the vegatation amount for this simulation. Once this method is
+  *           finished, the value will be updated.
+  * @param hooks
+  *           are the observers to call every time step, or NULL
+  * @return the number of steps taken in the simulation
+  */
+template <class Sum, class Update>
+int gameOfLife(int *grid, int nx, int ny, int maxSteps, int maxUnchanged,
+      int *pvegies, StepHooks *hooks)
+{
+   int step; /* counts the time steps */
+   bool converged; /* has the vegetation stabilized? */
+   ConvergenceTracker tracker; /* recent vegetation totals */
+   int vegies; /* total amount of vegetation */
+   int *tempGrid; /* grid to hold updated values */
+   int *scratch; /* row buffers for the Sum policy */
+   int i, j; /* loop counters */
+
+   tempGrid = poolAcquire(&gridPool);
+   scratch = (int*) ((char*) tempGrid + gridBytes(nx, ny));
+
+   step = 1;
+   vegies = 1;
+   convergenceStart(&tracker);
+   converged = false;
+
+   while (!converged && vegies > 0 && step < maxSteps)
+   {
+
+      /* Count the total amount of vegetation. */
+
+      vegies = 0;
+      for (i = 1; i <= nx; i++)
+      {
+         for (j = 1; j <= ny; j++)
+         {
+            vegies = vegies + ROW(grid, ny, i)[j];
+         }
+      }
+      converged = convergenceCheck(&tracker, vegies, maxUnchanged);
+      runStepHooks(hooks, grid, nx, ny, step, vegies);
+
+      if (!converged)
+      {
+         /* Copy the sides of the grid to make torus simple. */
+         for (i = 1; i <= nx; i++)
+         {
+            ROW(grid, ny, i)[0] = ROW(grid, ny, i)[ny];
+            ROW(grid, ny, i)[ny + 1] = ROW(grid, ny, i)[1];
+         }
+
+         for (j = 0; j <= ny + 1; j++)
+         {
+            ROW(grid, ny, 0)[j] = ROW(grid, ny, nx)[j];
+            ROW(grid, ny, nx + 1)[j] = ROW(grid, ny, 1)[j];
+         }
+
+         /* Now run one time step, putting result in tempGrid. */
+
+         Sum::template step<Update>(grid, tempGrid, nx, ny, scratch);
+
+         /* Now copy tempGrid back to grid. */
+
+         for (i = 1; i <= nx; i++)
+         {
+            for (j = 1; j <= ny; j++)
+            {
+               ROW(grid, ny, i)[j] = ROW(tempGrid, ny, i)[j];
+            }
+         }
+         step = step + 1;
+      } // if
+   } // while
+
+   poolRelease(&gridPool, tempGrid);
+
+   *pvegies = vegies;
+   return (step);
+} // gameOfLife
+
+
+# ifdef HAVE_X86_SIMD
+/**
+  * Makes the mask of the cells of a row from column j on that fit in one
+  * 64-byte vector.
+  *
+  * @param j
+  *           is the first column
+  * @param ny
+  *           is the y dimension of the grid
+  * @return the mask, with the columns past ny cleared
+  */
+__attribute__((target("avx512bw")))
+inline __mmask64 byteRowMask(int j, int ny)
+{
+   int n = ny - j + 1; /* columns left in the row */
+
+   return n >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << n) - 1;
+} // byteRowMask
+
+
+/**
+  * Converts the cells of an int grid to a byte grid, sixteen at a time. The
+  * halo is not copied.
+  *
+  * @param grid
+  *           is the int grid
+  * @param cells
+  *           is the byte grid, with rows of ny + 2 bytes
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  */
+__attribute__((target("avx512bw")))
+void bytePack(const int *grid, uint8_t *cells, int nx, int ny)
+{
+   int i, j; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
+   {
+      const int *from = ROW(grid, ny, i);
+      uint8_t *to = cells + (size_t) i * (ny + 2);
+
+      for (j = 1; j <= ny; j += 16)
+      {
+         __mmask16 m = (__mmask16) byteRowMask(j, ny);
+
+         _mm512_mask_cvtepi32_storeu_epi8(to + j, m,
+               _mm512_maskz_loadu_epi32(m, from + j));
+      }
+   }
+} // bytePack
+
+
+/**
+  * Converts the cells of a byte grid back to an int grid, sixteen at a time,
+  * and the row tails one at a time. The halo is not copied.
+  *
+  * @param cells
+  *           is the byte grid, with rows of ny + 2 bytes
+  * @param grid
+  *           is the int grid
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  */
+__attribute__((target("avx512bw")))
+void byteUnpack(const uint8_t *cells, int *grid, int nx, int ny)
+{
+   int i, j; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
+   {
+      const uint8_t *from = cells + (size_t) i * (ny + 2);
+      int *to = ROW(grid, ny, i);
+
+      for (j = 1; j + 15 <= ny; j += 16)
+      {
+         _mm512_storeu_si512(to + j, _mm512_maskz_cvtepu8_epi32(0xFFFF,
+               _mm_loadu_si128((const __m128i*) (from + j))));
+      }
+      for (; j <= ny; j++)
+         to[j] = from[j];
+   }
+} // byteUnpack
+
+
+/**
+  * Adds up the cells of a byte grid, 64 at a time. The halo is not counted.
+  *
+  * @param cells
+  *           is the byte grid, with rows of ny + 2 bytes
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @return the total amount of vegetation
+  */
+__attribute__((target("avx512bw")))
+int byteVegies(const uint8_t *cells, int nx, int ny)
+{
+   __m512i sums = _mm512_setzero_si512(); /* eight partial sums */
+   int64_t lanes[8]; /* the partial sums, added up at the end */
+   int vegies = 0; /* total amount of vegetation */
+   int i, j; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
+   {
+      const uint8_t *row = cells + (size_t) i * (ny + 2);
+
+      for (j = 1; j <= ny; j += 64)
+      {
+         __m512i c = _mm512_maskz_loadu_epi8(byteRowMask(j, ny), row + j);
+
+         sums = _mm512_add_epi64(sums,
+               _mm512_sad_epu8(c, _mm512_setzero_si512()));
+      }
+   }
+   _mm512_storeu_si512(lanes, sums);
+   for (i = 0; i < 8; i++)
+      vegies = vegies + (int) lanes[i];
+   return vegies;
+} // byteVegies
+
+
+/**
+  * Runs one time step on a byte grid whose halo is filled in, 64 cells per
+  * instruction. The masked loads and stores cover the row tails without
+  * reading or writing past the row, and the rule's decay and grow tests are
+  * compare masks that select which cells the saturating subtract and add
+  * apply to. Saturation at zero stands in for the clamp below VEG_MIN, since
+  * the max with VEG_MIN follows.
+  *
+  * @param cells
+  *           is the byte grid, with rows of ny + 2 bytes
+  * @param next
+  *           is where rows 1..nx of the next grid go
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  */
+template <class Rule>
+__attribute__((target("avx512bw")))
+void byteStep(const uint8_t *cells, uint8_t *next, int nx, int ny)
+{
+   const __m512i one = _mm512_set1_epi8(1);
+   const __m512i decayLow = _mm512_set1_epi8(Rule::decayLow);
+   const __m512i growMax = _mm512_set1_epi8(Rule::growMax);
+   const __m512i decayHigh = _mm512_set1_epi8(Rule::decayHigh);
+   const __m512i vegMin = _mm512_set1_epi8(Rule::vegMin);
+   const __m512i vegMax = _mm512_set1_epi8(Rule::vegMax);
+   const size_t stride = ny + 2; /* bytes per row, halo included */
+   int i, j; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
+   {
+      const uint8_t *up = cells + (i - 1) * stride;
+      const uint8_t *mid = cells + i * stride;
+      const uint8_t *down = cells + (i + 1) * stride;
+      uint8_t *out = next + i * stride;
+
+      for (j = 1; j <= ny; j += 64)
+      {
+         __mmask64 m = byteRowMask(j, ny);
+         __m512i c = _mm512_maskz_loadu_epi8(m, mid + j);
+         __m512i s = _mm512_add_epi8(
+               _mm512_add_epi8(
+                     _mm512_add_epi8(_mm512_maskz_loadu_epi8(m, up + j - 1),
+                           _mm512_maskz_loadu_epi8(m, up + j)),
+                     _mm512_add_epi8(_mm512_maskz_loadu_epi8(m, up + j + 1),
+                           _mm512_maskz_loadu_epi8(m, mid + j - 1))),
+               _mm512_add_epi8(
+                     _mm512_add_epi8(_mm512_maskz_loadu_epi8(m, mid + j + 1),
+                           _mm512_maskz_loadu_epi8(m, down + j - 1)),
+                     _mm512_add_epi8(_mm512_maskz_loadu_epi8(m, down + j),
+                           _mm512_maskz_loadu_epi8(m, down + j + 1))));
+         __mmask64 decay = _mm512_cmple_epu8_mask(s, decayLow)
+               | _mm512_cmpge_epu8_mask(s, decayHigh);
+         __mmask64 grow = _mm512_cmple_epu8_mask(s, growMax) & ~decay;
+
+         c = _mm512_mask_subs_epu8(c, decay, c, one);
+         c = _mm512_mask_adds_epu8(c, grow, c, one);
+         c = _mm512_min_epu8(_mm512_max_epu8(c, vegMin), vegMax);
+         _mm512_mask_storeu_epi8(out + j, m, c);
+      }
+   }
+} // byteStep
+
+
+/**
+  * Runs a simulation like gameOfLife, with the cells kept in bytes while it
+  * runs so that one AVX-512BW instruction handles 64 of them. The grid is
+  * converted to bytes on the way in and back on the way out, and on every
+  * step an observer needs it. Both byte grids fit in one pool slot. Compiled
+  * for AVX-512BW regardless of the build flags; only pick it when the CPU
+  * supports AVX-512BW.
+  *
+  * @param grid
+  *           is a grid of vegetation values
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @param maxSteps
+  *           is the max # of timesteps to simulate
+  * @param maxUnchanged
+  *           is the max # of timesteps with no vegetation change to simulate
+  * @param pvegies
+  *           is the vegatation amount for this simulation. Once this method is
+  *           finished, the value will be updated.
+  * @param hooks
+  *           are the observers to call every time step, or NULL
+  * @return the number of steps taken in the simulation
+  */
+template <class Rule>
+__attribute__((target("avx512bw")))
+int byteLife(int *grid, int nx, int ny, int maxSteps, int maxUnchanged,
+      int *pvegies, StepHooks *hooks)
+{
+   static_assert(Rule::vegMin >= 0 && Rule::neighborMax <= 255,
+         "byte rules need cells and neighbour sums that fit a byte");
+   static_assert(Rule::decayLow >= 0 && Rule::growMax >= 0
+         && Rule::decayHigh <= 255, "byte rules need thresholds in a byte");
+
+   const size_t stride = ny + 2; /* bytes per row, halo included */
+   const size_t bytes = ((nx + 2) * stride + 63) & ~(size_t) 63;
+   int step; /* counts the time steps */
+   bool converged; /* has the vegetation stabilized? */
+   ConvergenceTracker tracker; /* recent vegetation totals */
+   int vegies; /* total amount of vegetation */
+   int *slot; /* pool slot holding both byte grids */
+   uint8_t *cells; /* the grid in bytes */
+   uint8_t *next; /* the next grid in bytes */
+   uint8_t *swap; /* for exchanging cells and next */
+   int i; /* loop counter */
 
-   MPI::Status status;
-   int myId;
-   int numProcs;
+   slot = poolAcquire(&gridPool);
+   cells = (uint8_t*) slot;
+   next = cells + bytes;
+   bytePack(grid, cells, nx, ny);
 
-   //*** Initialize MPI, get rank and size
-   MPI::Init (argc, argv);
-   numProcs = MPI::COMM_WORLD.Get_size();
-   myId = MPI::COMM_WORLD.Get_rank();
+   step = 1;
+   vegies = 1;
+   convergenceStart(&tracker);
+   converged = false;
 
-   // Get input parameters in master and send values to all other processors.
-   if (myId == MASTER)
+   while (!converged && vegies > 0 && step < maxSteps)
    {
-	   // Initialize variables that only the master node will need to use.
-	   ndied = 0;
-	   nunsettled = 0;
-	   nstable = 0;
-	   totStepsStable = 0;
-	   totVegStable = 0;
-
-       // Output initial greeting from master node.
-       cout << "Processes available is " << numProcs << "\n";
+      vegies = byteVegies(cells, nx, ny);
+      converged = convergenceCheck(&tracker, vegies, maxUnchanged);
+      if (stepHooksNeedGrid(hooks, step))
+         byteUnpack(cells, grid, nx, ny);
+      runStepHooks(hooks, grid, nx, ny, step, vegies);
 
-	   nx = MAX_X + 1;
+      if (!converged)
+      {
+         /* Copy the sides of the grid to make torus simple. */
+         for (i = 1; i <= nx; i++)
+         {
+            cells[i * stride] = cells[i * stride + ny];
+            cells[i * stride + ny + 1] = cells[i * stride + 1];
+         }
+         memcpy(cells, cells + nx * stride, stride);
+         memcpy(cells + (nx + 1) * stride, cells + stride, stride);
 
-	   while (nx > MAX_X || ny > MAX_Y)
-	   {
-		  printf("Enter X and Y dimensions of wilderness: ");
-		  scanf("%d%d", &nx, &ny);
-	   }
+         /* Run one time step into next, then make it the grid. */
+         byteStep<Rule>(cells, next, nx, ny);
+         swap = cells;
+         cells = next;
+         next = swap;
+         step = step + 1;
+      }
+   }
 
-	   printf("\nEnter population probability: ");
-	   scanf("%lf", &prob);
+   byteUnpack(cells, grid, nx, ny);
+   poolRelease(&gridPool, slot);
 
-	   printf("\nEnter number of simulations: ");
-	   scanf("%d", &nsims);
+   *pvegies = vegies;
+   return (step);
+} // byteLife
+# endif
 
-	   printf("\nEnter random number seed: ");
-	   scanf("%d", &seed0);
 
-	   // Send input variables to all other processors.
-       for (i = 1; i < numProcs; i++)
-       {
-           MPI::COMM_WORLD.Send(&nx, 1, MPI_INTEGER, i, NX_TAG);
-           MPI::COMM_WORLD.Send(&ny, 1, MPI_INTEGER, i, NY_TAG);
-           MPI::COMM_WORLD.Send(&prob, 1, MPI_DOUBLE, i, PROB_TAG);
-           MPI::COMM_WORLD.Send(&nsims, 1, MPI_INTEGER, i, NSIMS_TAG);
-           MPI::COMM_WORLD.Send(&seed0, 1, MPI_INTEGER, i, SEED0_TAG);
-       }
+/**
+  * Adds two bitsliced numbers. Bit k of every number is word k of its array,
+  * so one full adder per bit adds 64 pairs of numbers at once. Bits past the
+  * end of a number are 0, and the carry out of the top bit of the sum is
+  * dropped, so the sum must fit NS bits.
+  *
+  * @param a
+  *           is the first number, NA bits
+  * @param b
+  *           is the second number, NB bits
+  * @param sum
+  *           is where the NS bits of the sum go
+  */
+template <int NA, int NB, int NS>
+inline void sliceAdd(const uint64_t *a, const uint64_t *b, uint64_t *sum)
+{
+   uint64_t carry = 0; /* carry into the bit */
 
-   } // if
-   else
+# pragma GCC unroll 8
+   for (int k = 0; k < NS; k++)
    {
-	   // Receive input variables from master node.
-	   MPI::COMM_WORLD.Recv(&nx, 1, MPI::INTEGER, MASTER, NX_TAG, status);
-	   MPI::COMM_WORLD.Recv(&ny, 1, MPI::INTEGER, MASTER, NY_TAG, status);
-	   MPI::COMM_WORLD.Recv(&prob, 1, MPI::DOUBLE, MASTER, PROB_TAG, status);
-	   MPI::COMM_WORLD.Recv(&nsims, 1, MPI::INTEGER, MASTER, NSIMS_TAG, status);
-	   MPI::COMM_WORLD.Recv(&seed0, 1, MPI::INTEGER, MASTER, SEED0_TAG, status);
+      uint64_t x = k < NA ? a[k] : 0; /* bit k of a */
+      uint64_t y = k < NB ? b[k] : 0; /* bit k of b */
+
+      sum[k] = x ^ y ^ carry;
+      carry = (x & y) | (carry & (x ^ y));
    }
+} // sliceAdd
 
-   //*** Common Code to be executed to all nodes
 
-   // Decide how many simulations each proc needs to run.
-   mySimsToRun = nsims / numProcs;
-   int simResultList[mySimsToRun * 2]; // 2d array represented in a normal array
+/**
+  * Compares bitsliced numbers with a constant, from the top bit down.
+  *
+  * @param x
+  *           is the numbers, N bits
+  * @param k
+  *           is the constant, known at compile time in practice so that the
+  *           compiler drops the branches
+  * @return the mask of the numbers that are at most k
+  */
+template <int N>
+inline uint64_t sliceAtMost(const uint64_t *x, int k)
+{
+   uint64_t less = 0; /* numbers known to be below k */
+   uint64_t equal = ~(uint64_t) 0; /* numbers equal to k so far */
 
-   // For as many times as this proc needs to, run simulations and record the
-   // results.
-   for (i = 0; i < mySimsToRun; i++)
+   if (k < 0)
+      return 0;
+   if (k >= (1 << N) - 1)
+      return ~(uint64_t) 0;
+# pragma GCC unroll 8
+   for (int b = N - 1; b >= 0; b--)
    {
-      // Compute which simulation this is, so that the number can be used in
-      // getting the seed. This replaces the "i" value in other versions.
-	  simulationNumber = (myId * mySimsToRun) + i + 1;
+      if ((k >> b) & 1)
+      {
+         less = less | (equal & ~x[b]);
+         equal = equal & x[b];
+      }
+      else
+      {
+         equal = equal & ~x[b];
+      }
+   }
+   return less | equal;
+} // sliceAtMost
 
-      // Initialize the grid values using the given probability.
-      seed = seed0 * simulationNumber;
-      initializeGrid(grid, nx, ny, seed, prob);
 
-      // Run a simulation and remember the vegetation and step results.
-      maxSteps = STEPS_MAX;
-      maxUnchanged = UNCHANGED_MAX;
-      nsteps = gameOfLife(grid, nx, ny, maxSteps, maxUnchanged, &vegies);
-      simResultList[(i * 2) + NVEGIES_INDEX] = vegies;
-      simResultList[(i * 2) + NSTEPS_INDEX] = nsteps;
-
-      printf("Number of time steps = %d, Vegetation total = %d\n", nsteps,
-            vegies);
-   } // for
+/**
+  * Makes the mask of the grid columns 1..ny within word w of a bitsliced
+  * row, so that the halo and the bits past the row stay out of the cells.
+  *
+  * @param w
+  *           is the word
+  * @param ny
+  *           is the y dimension of the grid
+  * @return the mask
+  */
+inline uint64_t sliceInterior(int w, int ny)
+{
+   int first = 64 * w; /* column of bit 0 of the word */
+   uint64_t mask = ~(uint64_t) 0;
 
-   //*** Separation of manager/worker code
-   if (myId != MASTER)
-   {
-      // Code for worker:
-      MPI::COMM_WORLD.Send(simResultList, mySimsToRun * 2, MPI::INTEGER,
-    		  MASTER, 1);
-   }
-   else
+   if (w == 0)
+      mask = mask & ~(uint64_t) 1;
+   if (ny + 1 - first < 64)
+      mask = mask & (((uint64_t) 1 << (ny + 1 - first)) - 1);
+   return mask;
+} // sliceInterior
+
+
+/**
+  * Converts the cells of an int grid to a bitsliced grid. The halo is not
+  * copied.
+  *
+  * @param grid
+  *           is the int grid
+  * @param cells
+  *           is the bitsliced grid
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  */
+void slicePack(const int *grid, uint64_t *cells, int nx, int ny)
+{
+   int words = sliceWords(ny); /* words per plane of a row */
+   int i, j, p; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
    {
-      // Code for master:
+      const int *from = ROW(grid, ny, i);
+      uint64_t *to = SLICE_ROW(cells, words, i);
 
-      // Record the master's own results first, then results of all workers.
-      for (i = 0; i < mySimsToRun; i++)
+      memset(to, 0, SLICE_PLANES * words * sizeof(uint64_t));
+      for (j = 1; j <= ny; j++)
       {
-    	  vegies = simResultList[(i * 2) + NVEGIES_INDEX];
-    	  nsteps = simResultList[(i * 2) + NSTEPS_INDEX];
+         for (p = 0; p < SLICE_PLANES; p++)
+            to[p * words + j / 64] |=
+                  (uint64_t) ((from[j] >> p) & 1) << (j % 64);
+      }
+   }
+} // slicePack
 
-         if (vegies == 0)
-         {
-            ndied = ndied + 1;
-         }
-         else if (nsteps >= maxSteps)
-         {
-            nunsettled = nunsettled + 1;
-         }
-         else
-         {
-            nstable = nstable + 1;
-            totStepsStable = totStepsStable + nsteps;
-            totVegStable = totVegStable + vegies;
-         }
-      } // for
 
-      // Get and record results of workers.
-      for (i = 1; i < numProcs; i++)
+/**
+  * Converts the cells of a bitsliced grid back to an int grid. The halo is
+  * not copied.
+  *
+  * @param cells
+  *           is the bitsliced grid
+  * @param grid
+  *           is the int grid
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  */
+void sliceUnpack(const uint64_t *cells, int *grid, int nx, int ny)
+{
+   int words = sliceWords(ny); /* words per plane of a row */
+   int i, j, p; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
+   {
+      const uint64_t *from = SLICE_ROW(cells, words, i);
+      int *to = ROW(grid, ny, i);
+
+      for (j = 1; j <= ny; j++)
       {
-         MPI::COMM_WORLD.Recv(simResultList, mySimsToRun * 2, MPI::INTEGER,
-        		 MPI::ANY_SOURCE, 1, status);
+         to[j] = 0;
+         for (p = 0; p < SLICE_PLANES; p++)
+            to[j] |= (int) ((from[p * words + j / 64] >> (j % 64)) & 1) << p;
+      }
+   }
+} // sliceUnpack
 
-         for (j = 0; j < mySimsToRun; j++)
-         {
-        	vegies = simResultList[(j * 2) + NVEGIES_INDEX];
-      	    nsteps = simResultList[(j * 2) + NSTEPS_INDEX];
 
-            if (vegies == 0)
-            {
-               ndied = ndied + 1;
-            }
-            else if (nsteps >= maxSteps)
-            {
-               nunsettled = nunsettled + 1;
-            }
-            else
-            {
-               nstable = nstable + 1;
-               totStepsStable = totStepsStable + nsteps;
-               totVegStable = totVegStable + vegies;
-            }
-         } // for
-      } // for
+/**
+  * Adds up the cells of a bitsliced grid: the population count of each
+  * plane, weighted by the plane's bit. The grid holds no bits outside its
+  * cells.
+  *
+  * @param cells
+  *           is the bitsliced grid
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  * @return the total amount of vegetation
+  */
+int sliceVegies(const uint64_t *cells, int nx, int ny)
+{
+   int words = sliceWords(ny); /* words per plane of a row */
+   int vegies = 0; /* total amount of vegetation */
+   int i, w, p; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
+   {
+      const uint64_t *row = SLICE_ROW(cells, words, i);
 
-      // If there was at least one simulation that stabilized, update the total
-      // steps and vegetation variables to reflect averages.
-      if (nstable > 0)
+      for (p = 0; p < SLICE_PLANES; p++)
       {
-         totStepsStable = totStepsStable / nstable;
-         totVegStable = totVegStable / nstable;
+         for (w = 0; w < words; w++)
+            vegies = vegies + (__builtin_popcountll(row[p * words + w]) << p);
       }
-   } // else
+   }
+   return vegies;
+} // sliceVegies
 
-   //*** Shut down MPI.
-   MPI::Finalize();
 
-   //*** Display results
-   if (myId == MASTER)
+/**
+  * Copies the sides and the first and last rows of a bitsliced grid to the
+  * halo, to make the torus simple.
+  *
+  * @param cells
+  *           is the bitsliced grid
+  * @param nx
+  *           is the x dimension of the grid
+  * @param ny
+  *           is the y dimension of the grid
+  */
+void sliceHalo(uint64_t *cells, int nx, int ny)
+{
+   int words = sliceWords(ny); /* words per plane of a row */
+   int i, p; /* loop counters */
+
+   for (i = 1; i <= nx; i++)
    {
-      printf("Percentage which died out: %g%%\n", 100.0 * ndied / nsims);
-      printf("Percentage unsettled:      %g%%\n", 100.0 * nunsettled / nsims);
-      printf("Percentage stabilized:     %g%%\n", 100.0 * nstable / nsims);
-      printf("  Of which:\n");
-      printf("  Average steps:           %g\n", totStepsStable);
-      printf("  Average vegetation:      %g\n", totVegStable);
-   }
+      for (p = 0; p < SLICE_PLANES; p++)
+      {
+         uint64_t *plane = SLICE_ROW(cells, words, i) + p * words;
+         uint64_t last = (plane[ny / 64] >> (ny % 64)) & 1; /* column ny */
+         uint64_t first = (plane[0] >> 1) & 1; /* column 1 */
 
-} // main
+         plane[0] = (plane[0] & ~(uint64_t) 1) | last;
+         plane[(ny + 1) / 64] = (plane[(ny + 1) / 64]
+               & ~((uint64_t) 1 << ((ny + 1) % 64)))
+               | (first << ((ny + 1) % 64));
+      }
+   }
+   memcpy(SLICE_ROW(cells, words, 0), SLICE_ROW(cells, words, nx),
+         SLICE_PLANES * words * sizeof(uint64_t));
+   memcpy(SLICE_ROW(cells, words, nx + 1), SLICE_ROW(cells, words, 1),
+         SLICE_PLANES * words * sizeof(uint64_t));
+} // sliceHalo
 
 
 /**
-  * Initializes an empty grid given grid dimensions, a seed, and vegetation
-  * probability.
+  * Runs one time step on a bitsliced grid whose halo is filled in, 64 cells
+  * per word operation. Like ColumnSum, the neighbourhood is built from
+  * column sums: the cells above and below are added first, then the cell
+  * itself, and a cell's neighbour sum is the column sums to its left and
+  * right plus the sum above and below it. Shifting a word by one bit moves
+  * every column sum one column over. The rule's thresholds are then
+  * comparator networks against constants, and the new cell is picked from
+  * the cell, the cell plus one and the cell minus one, then clamped.
   *
-  * @param grid
-  *           is a grid of vegetation values
+  * @param cells
+  *           is the bitsliced grid
+  * @param next
+  *           is where rows 1..nx of the next grid go
+  * @param scratch
+  *           has room for the 11 planes of the partial sums of a row
   * @param nx
   *           is the x dimension of the grid
   * @param ny
   *           is the y dimension of the grid
-  * @param seed
-  *           is a random number seed
-  * @param prob
-  *           is the population probability
   */
-void initializeGrid(int grid[][MAX_Y + 2], int nx, int ny, int seed,
-		double prob)
+template <class Rule>
+void sliceStep(const uint64_t *cells, uint64_t *next, uint64_t *scratch,
+      int nx, int ny)
 {
-   int i, j; /* loop counters */
-   int index; /* unique value for each grid cell */
-   int newSeed; /* unique seed for each grid point */
-   double rand1(int);
+   const int words = sliceWords(ny); /* words per plane of a row */
+   uint64_t *sides = scratch; /* 5 planes: the cells above plus below */
+   uint64_t *columns = scratch + 5 * words; /* 6 planes: the column sums */
+   int i, w, k; /* loop counters */
 
    for (i = 1; i <= nx; i++)
    {
-      for (j = 1; j <= ny; j++)
+      const uint64_t *up = SLICE_ROW(cells, words, i - 1);
+      const uint64_t *mid = SLICE_ROW(cells, words, i);
+      const uint64_t *down = SLICE_ROW(cells, words, i + 1);
+      uint64_t *out = SLICE_ROW(next, words, i);
+
+      for (w = 0; w < words; w++)
       {
-         index = ny * i + j;
-         newSeed = seed + index;
-         if (rand1(newSeed) > prob)
-            grid[i][j] = 0;
-         else
-            grid[i][j] = 1;
+         uint64_t a[SLICE_PLANES], b[SLICE_PLANES], c[SLICE_PLANES];
+         uint64_t side[5], column[6]; /* sums for this word */
+
+# pragma GCC unroll 8
+         for (k = 0; k < SLICE_PLANES; k++)
+         {
+            a[k] = up[k * words + w];
+            b[k] = down[k * words + w];
+            c[k] = mid[k * words + w];
+         }
+         sliceAdd<SLICE_PLANES, SLICE_PLANES, 5>(a, b, side);
+         sliceAdd<5, SLICE_PLANES, 6>(side, c, column);
+         for (k = 0; k < 5; k++)
+            sides[k * words + w] = side[k];
+         for (k = 0; k < 6; k++)
+            columns[k * words + w] = column[k];
+      }
+
+      for (w = 0; w < words; w++)
+      {
+         uint64_t left[6], right[6]; /* column sums one column over */
+         uint64_t pair[SLICE_SUM_BITS], sum[SLICE_SUM_BITS], side[5];
+         uint64_t c[SLICE_PLANES + 1], inc[SLICE_PLANES + 1];
+         uint64_t dec[SLICE_PLANES + 1], t[SLICE_PLANES + 1];
+         uint64_t decay, grow, keep, negative, low, high, carry, borrow;
+
+# pragma GCC unroll 8
+         for (k = 0; k < 6; k++)
+         {
+            const uint64_t *plane = columns + k * words;
+
+            left[k] = (plane[w] << 1) | (w > 0 ? plane[w - 1] >> 63 : 0);
+            right[k] = (plane[w] >> 1)
+                  | (w + 1 < words ? plane[w + 1] << 63 : 0);
+         }
+         for (k = 0; k < 5; k++)
+            side[k] = sides[k * words + w];
+         sliceAdd<6, 6, SLICE_SUM_BITS>(left, right, pair);
+         sliceAdd<SLICE_SUM_BITS, 5, SLICE_SUM_BITS>(pair, side, sum);
+
+         decay = sliceAtMost<SLICE_SUM_BITS>(sum, Rule::decayLow)
+               | ~sliceAtMost<SLICE_SUM_BITS>(sum, Rule::decayHigh - 1);
+         grow = sliceAtMost<SLICE_SUM_BITS>(sum, Rule::growMax) & ~decay;
+         keep = ~(decay | grow);
+
+         // The cell plus one and minus one, by ripple carry and borrow.
+         carry = ~(uint64_t) 0;
+         borrow = ~(uint64_t) 0;
+# pragma GCC unroll 8
+         for (k = 0; k < SLICE_PLANES; k++)
+         {
+            c[k] = mid[k * words + w];
+            inc[k] = c[k] ^ carry;
+            carry = carry & c[k];
+            dec[k] = c[k] ^ borrow;
+            borrow = borrow & ~c[k];
+         }
+         c[SLICE_PLANES] = 0;
+         inc[SLICE_PLANES] = carry;
+         dec[SLICE_PLANES] = 0;
+# pragma GCC unroll 8
+         for (k = 0; k <= SLICE_PLANES; k++)
+            t[k] = (grow & inc[k]) | (decay & dec[k]) | (keep & c[k]);
+
+         negative = decay & borrow;
+         low = negative | sliceAtMost<SLICE_PLANES + 1>(t, Rule::vegMin - 1);
+         high = ~low & ~sliceAtMost<SLICE_PLANES + 1>(t, Rule::vegMax);
+# pragma GCC unroll 8
+         for (k = 0; k < SLICE_PLANES; k++)
+         {
+            out[k * words + w] = ((t[k] & ~low & ~high)
+                  | (((Rule::vegMin >> k) & 1) ? low : 0)
+                  | (((Rule::vegMax >> k) & 1) ? high : 0))
+                  & sliceInterior(w, ny);
+         }
       }
    }
-} // initializeGrid
+} // sliceStep
 
 
 /**
-  * Runs a simulation of the game of life given an initialized grid,
-  * dimensions, and loop restrictions.
+  * Runs a simulation like gameOfLife, with the grid bitsliced while it runs:
+  * each of the four bits of the cells has its own plane of 64-bit words, and
+  * a step is adder and comparator networks of word operations, each of which
+  * updates 64 cells. The grid is converted on the way in and back on the way
+  * out, and on every step an observer needs it.
   *
   * @param grid
   *           is a grid of vegetation values
@@ -291,116 +5703,84 @@ void initializeGrid(int grid[][MAX_Y + 2], int nx, int ny, int seed,
   * @param pvegies
   *           is the vegatation amount for this simulation. Once this method is
   *           finished, the value will be updated.
+  * @param hooks
+  *           are the observers to call every time step, or NULL
   * @return the number of steps taken in the simulation
   */
-int gameOfLife(int grid[][MAX_Y + 2], int nx, int ny, int maxSteps,
-		int maxUnchanged, int *pvegies)
+template <class Rule>
+int sliceLife(int *grid, int nx, int ny, int maxSteps, int maxUnchanged,
+      int *pvegies, StepHooks *hooks)
 {
+   static_assert(Rule::vegMin >= 0 && Rule::vegMax < (1 << SLICE_PLANES),
+         "bitsliced rules need cells that fit SLICE_PLANES bits");
+   static_assert(Rule::neighborMax < (1 << SLICE_SUM_BITS),
+         "bitsliced rules need neighbour sums that fit SLICE_SUM_BITS bits");
+
+   const size_t gridWords = (size_t) (nx + 2) * SLICE_PLANES * sliceWords(ny);
    int step; /* counts the time steps */
-   int converged; /* has the vegetation stabilized? */
-   int numUnchanged; /* # timesteps with no vegetation change */
-   int oldVegies; /* previous level of vegetation */
-   int old2Vegies; /* previous level of vegetation */
-   int old3Vegies; /* previous level of vegetation */
+   bool converged; /* has the vegetation stabilized? */
+   ConvergenceTracker tracker; /* recent vegetation totals */
    int vegies; /* total amount of vegetation */
-   int neighbors; /* quantity of neighboring vegetation */
-   int tempGrid[MAX_X][MAX_Y]; /* grid to hold updated values */
-   int i, j; /* loop counters */
+   int *slot; /* pool slot holding both grids and the scratch */
+   uint64_t *cells; /* the bitsliced grid */
+   uint64_t *next; /* the next bitsliced grid */
+   uint64_t *scratch; /* partial sums of a row */
+   uint64_t *swap; /* for exchanging cells and next */
+
+   slot = poolAcquire(&gridPool);
+   cells = (uint64_t*) slot;
+   next = cells + gridWords;
+   scratch = next + gridWords;
+   slicePack(grid, cells, nx, ny);
 
    step = 1;
    vegies = 1;
-   oldVegies = -1;
-   old2Vegies = -1;
-   old3Vegies = -1;
-   numUnchanged = 0;
-   converged = 0;
+   convergenceStart(&tracker);
+   converged = false;
 
    while (!converged && vegies > 0 && step < maxSteps)
    {
-
-      /* Count the total amount of vegetation. */
-
-      vegies = 0;
-      for (i = 1; i <= nx; i++)
-      {
-         for (j = 1; j <= ny; j++)
-         {
-            vegies = vegies + grid[i][j];
-         }
-      }
-      if (vegies == oldVegies || vegies == old2Vegies || vegies == old3Vegies)
-      {
-         numUnchanged = numUnchanged + 1;
-         if (numUnchanged >= maxUnchanged)
-            converged = 1;
-      }
-      else
-      {
-         numUnchanged = 0;
-      }
-      old3Vegies = old2Vegies;
-      old2Vegies = oldVegies;
-      oldVegies = vegies;
-
-      // Use to show step results in detail:
-      //printf(" step %d: vegies = %d\n", step, vegies);
+      vegies = sliceVegies(cells, nx, ny);
+      converged = convergenceCheck(&tracker, vegies, maxUnchanged);
+      if (stepHooksNeedGrid(hooks, step))
+         sliceUnpack(cells, grid, nx, ny);
+      runStepHooks(hooks, grid, nx, ny, step, vegies);
 
       if (!converged)
       {
-         /* Copy the sides of the grid to make torus simple. */
-         for (i = 1; i <= nx; i++)
-         {
-            grid[i][0] = grid[i][ny];
-            grid[i][ny + 1] = grid[i][1];
-         }
-
-         for (j = 0; j <= ny + 1; j++)
-         {
-            grid[0][j] = grid[nx][j];
-            grid[nx + 1][j] = grid[1][j];
-         }
-
-         /* Now run one time step, putting result in tempGrid. */
-
-         for (i = 1; i <= nx; i++)
-         {
-            for (j = 1; j <= ny; j++)
-            {
-               neighbors = grid[i - 1][j - 1] + grid[i - 1][j]
-                     + grid[i - 1][j + 1] + grid[i][j - 1] + grid[i][j + 1]
-                     + grid[i + 1][j - 1] + grid[i + 1][j] + grid[i + 1][j + 1];
-               tempGrid[i][j] = grid[i][j];
-               if (neighbors >= 25 || neighbors <= 3)
-               {
-                  tempGrid[i][j] = tempGrid[i][j] - 1;
-                  if (tempGrid[i][j] < 0)
-                     tempGrid[i][j] = 0;
-               }
-               else if (neighbors <= 15)
-               {
-                  tempGrid[i][j] = tempGrid[i][j] + 1;
-                  if (tempGrid[i][j] > 10)
-                     tempGrid[i][j] = 10;
-               }
-            } // for
-         } // for
-
-         /* Now copy tempGrid back to grid. */
-
-         for (i = 1; i <= nx; i++)
-         {
-            for (j = 1; j <= ny; j++)
-            {
-               grid[i][j] = tempGrid[i][j];
-            }
-         }
+         sliceHalo(cells, nx, ny);
+         sliceStep<Rule>(cells, next, scratch, nx, ny);
+         swap = cells;
+         cells = next;
+         next = swap;
          step = step + 1;
-      } // if
-   } // while
+      }
+   }
+
+   sliceUnpack(cells, grid, nx, ny);
+   poolRelease(&gridPool, slot);
 
    *pvegies = vegies;
    return (step);
-} // gameOfLife
+} // sliceLife
+
+
+/**
+  * Computes the seed of a simulation. It depends only on the simulation's
+  * number, never on the rank that runs it, so simulation k gets the same
+  * grid however many ranks share the work. The product wraps around at 32
+  * bits, as the seeds always have.
+  *
+  * @param seed0
+  *           is the random number seed given as input
+  * @param number
+  *           is the number of the simulation, starting at 1
+  * @return the seed
+  */
+int simulationSeed(int seed0, int number)
+{
+   return (int32_t) ((uint32_t) seed0 * (uint32_t) number);
+} // simulationSeed
 
 
 /**